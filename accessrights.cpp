@@ -2,13 +2,15 @@
 // Created by enrico on 21.03.21.
 //
 #include "OrthancPluginCppWrapper.h"
-#include <regex>
+#include <cstring>
+#include <memory>
+#include "matcher.hpp"
 
-std::regex localIpRegex_;
+std::unique_ptr<Matcher> localIpRegex_;
 
 int32_t http_request_filter(OrthancPluginHttpMethod method, const char *uri, const char *ip, uint32_t headersCount, const char *const *headersKeys, const char *const *headersValues){
 
-	if(!std::regex_match(ip,localIpRegex_)){
+	if(!localIpRegex_->match(ip, ip+strlen(ip))){
 		return 0; //reject with 403
 	}
 
@@ -33,16 +35,15 @@ ORTHANC_PLUGINS_API int32_t OrthancPluginInitialize(OrthancPluginContext* c)
 	return -1;
 	}
 
-	localIpRegex_ = std::regex(
-	OrthancPlugins::OrthancConfiguration().GetStringValue("LocalIpRegex", "127.0.0.1"),
-		std::regex_constants::ECMAScript | std::regex_constants::optimize
-	);
+	localIpRegex_.reset(new Matcher(
+	OrthancPlugins::OrthancConfiguration().GetStringValue("LocalIpRegex", "127.0.0.1")
+	));
 	OrthancPluginRegisterIncomingHttpRequestFilter 	(c,http_request_filter);
 
 	return 0;
 }
 
-ORTHANC_PLUGINS_API void OrthancPluginFinalize(){}
+ORTHANC_PLUGINS_API void OrthancPluginFinalize(){localIpRegex_.reset();}
 ORTHANC_PLUGINS_API const char* OrthancPluginGetName()
 {
 	return "http access filter";
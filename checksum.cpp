@@ -0,0 +1,49 @@
+#include "checksum.hpp"
+#include "fileio.hpp"
+#include "xxhash.hpp"
+#include <sys/xattr.h>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+const char *const ChecksumAttribute = "user.shadowwriter.xxh64";
+}
+
+bool fileChecksum(int fd, uint64_t &sum, Throttle *throttle)
+{
+	XXH64 state;
+	std::vector<char> buffer(1 << 20);
+	for(off_t offset = 0;;){
+		const ssize_t red = preadAll(fd, buffer.data(), buffer.size(), offset);
+		if(red < 0)
+			return false;
+		if(throttle)
+			throttle->acquire(red);
+		state.update(buffer.data(), red);
+		offset += red;
+		if(size_t(red) < buffer.size())
+			break;
+	}
+	sum = state.digest();
+	return true;
+}
+
+bool storedChecksum(const boost::filesystem::path &file, uint64_t &sum)
+{
+	char buffer[17];
+	const ssize_t len = getxattr(file.c_str(), ChecksumAttribute, buffer, 16);
+	if(len != 16)
+		return false;
+	buffer[16] = '\0';
+	char *end;
+	sum = strtoull(buffer, &end, 16);
+	return *end == '\0';
+}
+
+bool storeChecksum(const boost::filesystem::path &file, uint64_t sum)
+{
+	char buffer[17];
+	snprintf(buffer, sizeof(buffer), "%.16llx", (unsigned long long)sum);
+	return setxattr(file.c_str(), ChecksumAttribute, buffer, 16, 0) == 0;
+}
@@ -0,0 +1,19 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include "throttle.hpp"
+
+/*
+ * XXH64 checksums of stored files, kept as extended attribute ("user.shadowwriter.xxh64", in hex) of the file.
+ * They are of the file as it is on disk, so for compressed attachments that's the compressed data.
+ */
+
+/// checksum of the whole file, reading is paced by throttle (in bytes) if given; false if the file can't be read
+bool fileChecksum(int fd, uint64_t &sum, Throttle *throttle = nullptr);
+/// false if file has no (valid) checksum
+bool storedChecksum(const boost::filesystem::path &file, uint64_t &sum);
+bool storeChecksum(const boost::filesystem::path &file, uint64_t sum);
+
+#endif //CHECKSUM_HPP
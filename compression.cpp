@@ -0,0 +1,85 @@
+#include "compression.hpp"
+#include "fileio.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const char Magic[8] = {'\x89', 'S', 'W', 'Z', '\r', '\n', '\x1a', '\n'};
+const size_t HeaderSize = 16;
+const size_t Chunk = 256 * 1024; // zlib counts in uInt, so big buffers are fed in pieces
+}
+
+bool compressContent(const void *data, size_t size, std::vector<char> &out, int level)
+{
+	z_stream zs{};
+	if(deflateInit(&zs, level) != Z_OK)
+		return false;
+	out.resize(HeaderSize + deflateBound(&zs, size));
+	memcpy(out.data(), Magic, sizeof(Magic));
+	for(int i = 0; i < 8; i++)
+		out[8 + i] = char(uint64_t(size) >> (8 * i));
+
+	const char *in = static_cast<const char *>(data);
+	size_t consumed = 0, produced = HeaderSize;
+	int ret = Z_OK;
+	while(ret == Z_OK){
+		const size_t in_chunk = std::min(size - consumed, Chunk), out_chunk = std::min(out.size() - produced, Chunk);
+		zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in + consumed));
+		zs.avail_in = uInt(in_chunk);
+		zs.next_out = reinterpret_cast<Bytef *>(out.data() + produced);
+		zs.avail_out = uInt(out_chunk);
+		ret = deflate(&zs, consumed + in_chunk == size ? Z_FINISH : Z_NO_FLUSH);
+		consumed += in_chunk - zs.avail_in;
+		produced += out_chunk - zs.avail_out;
+		if(produced >= size) // not worth it
+			break;
+	}
+	deflateEnd(&zs);
+	if(ret != Z_STREAM_END || produced >= size)
+		return false;
+	out.resize(produced);
+	return true;
+}
+
+bool isCompressed(int fd, uint64_t &size)
+{
+	unsigned char header[HeaderSize];
+	if(preadAll(fd, header, HeaderSize, 0) < ssize_t(HeaderSize) || memcmp(header, Magic, sizeof(Magic)))
+		return false;
+	size = 0;
+	for(int i = 0; i < 8; i++)
+		size |= uint64_t(header[8 + i]) << (8 * i);
+	return true;
+}
+
+bool inflateRange(int fd, void *target, uint64_t count, uint64_t offset)
+{
+	z_stream zs{};
+	if(inflateInit(&zs) != Z_OK)
+		return false;
+	std::vector<char> in(Chunk), skip(offset ? Chunk : 0);
+	char *out = static_cast<char *>(target);
+	off_t file_offset = HeaderSize;
+	uint64_t produced = 0; // of the uncompressed content, including what was skipped
+	int ret = Z_OK;
+	while(ret == Z_OK && produced < offset + count){
+		if(zs.avail_in == 0){
+			const ssize_t red = preadAll(fd, in.data(), in.size(), file_offset);
+			if(red <= 0)
+				break;
+			file_offset += red;
+			zs.next_in = reinterpret_cast<Bytef *>(in.data());
+			zs.avail_in = uInt(red);
+		}
+		// everything before offset goes into the scratch buffer
+		const bool skipping = produced < offset;
+		const size_t room = skipping ? std::min<uint64_t>(offset - produced, Chunk) : std::min<uint64_t>(offset + count - produced, Chunk);
+		zs.next_out = reinterpret_cast<Bytef *>(skipping ? skip.data() : out + (produced - offset));
+		zs.avail_out = uInt(room);
+		ret = inflate(&zs, Z_NO_FLUSH);
+		produced += room - zs.avail_out;
+	}
+	inflateEnd(&zs);
+	return produced >= offset + count && (ret == Z_OK || ret == Z_STREAM_END);
+}
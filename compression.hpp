@@ -0,0 +1,21 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * zlib compression of attachments that are no DICOM files (shadows must stay plain DICOM).
+ * A compressed file is a 16 byte header (magic and the uncompressed size, little endian) followed by a zlib stream.
+ * Files without the header are plain, so attachments stored before compression was switched on still work.
+ */
+
+/// deflates data into out (header included), returns false if that doesn't make it smaller
+bool compressContent(const void *data, size_t size, std::vector<char> &out, int level);
+/// true if the file starts with the header, size is set to the uncompressed size then
+bool isCompressed(int fd, uint64_t &size);
+/// inflates count bytes, starting at offset of the uncompressed content, from the compressed file fd into target
+bool inflateRange(int fd, void *target, uint64_t count, uint64_t offset = 0);
+
+#endif //COMPRESSION_HPP
@@ -0,0 +1,118 @@
+#include "dedupstore.hpp"
+#include "shadowtree.hpp"
+#include "fileio.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace {
+const char *const BlobAttribute = "user.shadowwriter.blob";
+
+bool sameContent(int fd, const void *content, size_t size)
+{
+	std::vector<char> buffer(std::min<size_t>(size, 1 << 20));
+	for(size_t offset = 0; offset < size;){
+		const size_t want = std::min(buffer.size(), size - offset);
+		if(preadAll(fd, buffer.data(), want, offset) < ssize_t(want) ||
+			memcmp(buffer.data(), static_cast<const char *>(content) + offset, want))
+			return false;
+		offset += want;
+	}
+	return true;
+}
+}
+
+DedupStore::DedupStore(fs::path root):root(std::move(root)){}
+
+fs::path DedupStore::blobPath(uint64_t hash, const std::string &uuid)const
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%.16llx", (unsigned long long)hash);
+	return layout.base(uuid, root) / ".dedup" / std::string(name, 2) / name;
+}
+
+bool DedupStore::link(uint64_t hash, const void *content, size_t size, const std::string &uuid, const fs::path &path)
+{
+	const fs::path blob = blobPath(hash, uuid);
+	FileDescriptor file(blob.c_str(), O_RDONLY);
+	struct stat st;
+	if(!file.good() || fstat(file, &st))
+		return false;
+	if(size_t(st.st_size) != size || !sameContent(file, content, size)){
+		mismatches++;
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	struct stat now; // make sure it wasn't dropped (and maybe replaced) while we were comparing
+	if(stat(blob.c_str(), &now) || now.st_ino != st.st_ino || now.st_dev != st.st_dev)
+		return false;
+	int erg = ::link(blob.c_str(), path.c_str());
+	if(erg && errno == ENOENT && makeDirectory(path.parent_path()))
+		erg = ::link(blob.c_str(), path.c_str());
+	if(erg){
+		OrthancPlugins::LogWarning(std::string("Failed to link \"") + path.native() + "\" to \"" + blob.native() + "\" " + strerror(errno));
+		return false;
+	}
+	hits++;
+	saved += size;
+	return true;
+}
+
+void DedupStore::add(uint64_t hash, const std::string &uuid, const fs::path &org)
+{
+	const fs::path blob = blobPath(hash, uuid);
+	if(setxattr(org.c_str(), BlobAttribute, blob.c_str(), blob.native().size(), 0)){
+		OrthancPlugins::LogWarning(std::string("Failed to mark \"") + org.native() + "\" as deduplicated " + strerror(errno));
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	int erg = ::link(org.c_str(), blob.c_str());
+	if(erg && errno == ENOENT && makeDirectory(blob.parent_path()))
+		erg = ::link(org.c_str(), blob.c_str());
+	if(erg){ // EEXIST is a file with the same hash but other content (or a copy written at the same time)
+		removexattr(org.c_str(), BlobAttribute);
+		return;
+	}
+	added++;
+}
+
+bool DedupStore::release(const fs::path &org, const fs::path &shadow)
+{
+	const fs::path blob = blobOf(org);
+	if(blob.empty())
+		return false;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	struct stat o, b;
+	if(stat(org.c_str(), &o))
+		return false;
+	struct stat sh; // a symlink shadow (see createShadow) is not one of the links
+	const bool has_shadow = !shadow.empty() && lstat(shadow.c_str(), &sh) == 0 && S_ISREG(sh.st_mode) &&
+		sh.st_ino == o.st_ino && sh.st_dev == o.st_dev;
+	const bool has_blob = stat(blob.c_str(), &b) == 0 && b.st_ino == o.st_ino && b.st_dev == o.st_dev;
+	const long others = long(o.st_nlink) - 1 - has_shadow - has_blob;
+	if(others > 0){
+		if(unlink(org.c_str()) == 0){
+			released++;
+			return true;
+		}
+		return false; // let the caller try and complain
+	}
+	if(has_blob && unlink(blob.c_str()))
+		OrthancPlugins::LogWarning(std::string("Failed to remove \"") + blob.native() + "\" " + strerror(errno));
+	return false;
+}
+
+fs::path DedupStore::blobOf(const fs::path &file)
+{
+	char buffer[4096];
+	const ssize_t len = getxattr(file.c_str(), BlobAttribute, buffer, sizeof(buffer));
+	return len > 0 ? fs::path(std::string(buffer, len)) : fs::path();
+}
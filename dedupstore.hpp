@@ -0,0 +1,42 @@
+#ifndef DEDUPSTORE_HPP
+#define DEDUPSTORE_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <mutex>
+
+/**
+ * Content addressed deduplication of originals.
+ * The first file with some content becomes the "blob" for its XXH64 hash by getting a second hardlink as
+ * root[/shard]/.dedup/xx/<hash>, later files with the same content (compared byte by byte) are just further hardlinks to it.
+ * So the filesystem is the persistent hash index, and the link count is the reference count: besides the blob and
+ * maybe the shadow, every link is an attachment. The blob path is stored as extended attribute of the file.
+ * Hardlinks can't cross devices, so with shards only copies that end up in the same shard are deduplicated.
+ */
+class DedupStore
+{
+	const boost::filesystem::path root;
+	std::mutex mutex; // linking to a blob and dropping it after the last reference must not interleave
+	boost::filesystem::path blobPath(uint64_t hash, const std::string &uuid)const;
+public:
+	// duplicates linked instead of written, bytes that were not written because of that, new blobs, files with a known
+	// hash but different content, attachments removed while others still use their content
+	std::atomic<uint64_t> hits{0}, saved{0}, added{0}, mismatches{0}, released{0};
+
+	/// root is the storage directory
+	explicit DedupStore(boost::filesystem::path root);
+	/// if there is a blob with exactly that content, it is linked as path (the file of uuid) and true is returned
+	bool link(uint64_t hash, const void *content, size_t size, const std::string &uuid, const boost::filesystem::path &path);
+	/// makes the freshly written org (the file of uuid) the blob for hash, so later copies can be linked to it
+	void add(uint64_t hash, const std::string &uuid, const boost::filesystem::path &org);
+	/**
+	 * To be called before removing org (with shadow being its shadow path, if known).
+	 * If other attachments still share the content, org is removed and true is returned. Otherwise the blob (if any)
+	 * is removed, and removing org and its shadow is left to the caller.
+	 */
+	bool release(const boost::filesystem::path &org, const boost::filesystem::path &shadow);
+	/// the blob file is linked to, empty if it is not deduplicated
+	static boost::filesystem::path blobOf(const boost::filesystem::path &file);
+};
+
+#endif //DEDUPSTORE_HPP
@@ -3,8 +3,21 @@
 //
 
 #include "dicomhandle.hpp"
-DicomHandle::DicomHandle(const void *buffer, size_t size)
+#include "dicomscanner.hpp"
+#include <cstring>
+
+DicomHandle::DicomHandle(const void *buffer, size_t size, bool header_only)
 {
+	if(header_only){
+		// find where PixelData starts, everything from there on is kept as it is
+		DicomScanner scanner({DicomScanner::PixelData-1});
+		if(scanner.scan(buffer,size) && !scanner.isDeflated() && scanner.stopOffset()<size){
+			tail=static_cast<const char*>(buffer)+scanner.stopOffset();
+			tail_size=size-scanner.stopOffset();
+			size=scanner.stopOffset();
+		}
+	}
+
 	DcmInputBufferStream is;
 	if (size > 0) {
 		is.setBuffer(buffer, size);
@@ -18,6 +31,9 @@ DicomHandle::DicomHandle(const void *buffer, size_t size)
 		valid=true;
 		loadAllDataIntoMemory();
 		transferEnd();
+		// the length of the PixelData group can't be recalculated without the PixelData, but it's optional anyway
+		if(tail)
+			getDataset()->findAndDeleteElement(DcmTagKey(0x7fe0, 0x0000));
 	}
 }
 std::string DicomHandle::findString(const DcmTagKey &key)
@@ -40,50 +56,100 @@ std::string DicomHandle::findString(const DcmTagKey &key)
 bool DicomHandle::replaceString(DcmTagKey key, std::string replacement)
 {
 	DcmDataset *dset = getDataset();
-	if(dset->putAndInsertOFStringArray(key,replacement.c_str()).good()){
+	if(!dset->putAndInsertOFStringArray(key,replacement.c_str()).good()){
 		OrthancPlugins::LogError(std::string("Failed to replace ") + DcmTag(key).getTagName() +" with \""+replacement+"\"");
 		return false;
 	} else
 		return true;
 }
-bool DicomHandle::SaveToMemoryBuffer(OrthancPluginMemoryBuffer *target)
+bool DicomHandle::outputSyntax(E_TransferSyntax &xfer)
 {
-	DcmDataset *dataSet = getDataset();
-
-	E_TransferSyntax xfer = dataSet->getOriginalXfer();
-	if (xfer == EXS_Unknown)
+	xfer = getDataset()->getOriginalXfer();
+	if (xfer == EXS_Unknown && tail)
+	{
+		// the tail has to stay in the syntax it was in
+		OrthancPlugins::LogError("Unknown transfer syntax, can't write a dicom file parsed only up to PixelData");
+		return false;
+	}
+	else if (xfer == EXS_Unknown)
 	{
 		// No information about the original transfer syntax: This is
 		// most probably a DICOM dataset that was read from memory.
 		xfer = EXS_LittleEndianExplicit;
 	}
 
-	E_EncodingType encodingType = /*opt_sequenceType*/ EET_ExplicitLength;
-
 //		// Create the meta-header information
 	//do we need this - should already be in place, right ?
 //		validateMetaInfo(xfer);
 //		removeInvalidGroups();
+	return true;
+}
 
-	// Create a memory buffer with the proper size
-	const uint32_t estimatedSize = calcElementLength(xfer, encodingType);  // (*)
-	OrthancPluginCreateMemoryBuffer(OrthancPlugins::GetGlobalContext(), target, estimatedSize);
-
-	DcmOutputBufferStream ob(target->data, estimatedSize);
+bool DicomHandle::writeTo(void *data, uint64_t capacity, E_TransferSyntax xfer, uint64_t &written)
+{
+	DcmOutputBufferStream ob(data, capacity - tail_size);
 
 	// Fill the memory buffer with the meta-header and the dataset
 	transferInit();
-	OFCondition c = write(ob, xfer, encodingType, nullptr,
+	OFCondition c = write(ob, xfer, EncodingType, nullptr,
 		/*opt_groupLength*/ EGL_recalcGL,
 		/*opt_paddingType*/ EPD_withoutPadding);
 	transferEnd();
+	if (c.bad())
+		return false;
 
-	if (c.good()) {
-		ob.flush();
+	ob.flush();
+	written = capacity;
+	if(tail){ // the header is re-encoded with explicit lengths, so it ends right where it was written to
+		written = ob.tell();
+		memcpy(static_cast<char*>(data) + written, tail, tail_size);
+		written += tail_size;
+	}
+	return true;
+}
+
+bool DicomHandle::SaveToMemoryBuffer(OrthancPluginMemoryBuffer *target)
+{
+	E_TransferSyntax xfer;
+	if(!outputSyntax(xfer))
+		return false;
+
+	// Create a memory buffer with the proper size
+	const uint32_t estimatedSize = calcElementLength(xfer, EncodingType) + tail_size;  // (*)
+	if(OrthancPluginCreateMemoryBuffer(OrthancPlugins::GetGlobalContext(), target, estimatedSize) != OrthancPluginErrorCode_Success)
+		return false;
+
+	uint64_t written;
+	if (writeTo(target->data, estimatedSize, xfer, written)) {
+		target->size = written;
 		return true;
 	} else {
 		// Error
 		OrthancPluginFreeMemoryBuffer(OrthancPlugins::GetGlobalContext(), target);
+		target->data = nullptr; // so wrappers don't free it again
+		target->size = 0;
+		return false;
+	}
+}
+
+bool DicomHandle::SaveToMemoryBuffer(OrthancPluginMemoryBuffer64 *target)
+{
+	E_TransferSyntax xfer;
+	if(!outputSyntax(xfer))
+		return false;
+
+	const uint64_t estimatedSize = uint64_t(calcElementLength(xfer, EncodingType)) + tail_size;
+	if(OrthancPluginCreateMemoryBuffer64(OrthancPlugins::GetGlobalContext(), target, estimatedSize) != OrthancPluginErrorCode_Success)
+		return false;
+
+	uint64_t written;
+	if (writeTo(target->data, estimatedSize, xfer, written)) {
+		target->size = written;
+		return true;
+	} else {
+		OrthancPluginFreeMemoryBuffer64(OrthancPlugins::GetGlobalContext(), target);
+		target->data = nullptr;
+		target->size = 0;
 		return false;
 	}
 }
@@ -10,12 +10,27 @@
 #include <dcmtk/dcmdata/dcostrmb.h>
 #include "OrthancPluginCppWrapper.h"
 
+/**
+ * DCMTK file parsed from memory.
+ * With header_only the file is only parsed up to PixelData (if it has any and isn't deflated). The rest of the file
+ * isn't decoded at all, SaveToMemoryBuffer writes the (changed) header and copies that tail behind it as it was. The
+ * buffer has to outlive the handle then, and nothing at or after PixelData may be changed.
+ */
 class DicomHandle:public DcmFileFormat
 {
+	const char *tail=nullptr; // the unparsed rest of the file in header_only mode
+	size_t tail_size=0;
+	static const E_EncodingType EncodingType = /*opt_sequenceType*/ EET_ExplicitLength;
+
+	bool outputSyntax(E_TransferSyntax &xfer);
+	/// writes the file into data (of calcElementLength + tail_size bytes), written is how much of that was used
+	bool writeTo(void *data, uint64_t capacity, E_TransferSyntax xfer, uint64_t &written);
 public:
 	bool valid=false;
-	DicomHandle(const void* buffer, size_t size);
+	DicomHandle(const void* buffer, size_t size, bool header_only=false);
+	bool headerOnly()const{return tail!=nullptr;}
 	bool SaveToMemoryBuffer(OrthancPluginMemoryBuffer *target);
+	bool SaveToMemoryBuffer(OrthancPluginMemoryBuffer64 *target);
 	std::string findString(const DcmTagKey& key);
 	bool replaceString(DcmTagKey key, std::string replacement);
 };
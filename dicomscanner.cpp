@@ -0,0 +1,230 @@
+#include "dicomscanner.hpp"
+#include <algorithm>
+#include <cstring>
+#include <zlib.h>
+
+namespace {
+const uint32_t UndefinedLength = 0xFFFFFFFF;
+const DicomScanner::Tag Item = 0xFFFEE000, ItemDelimitation = 0xFFFEE00D, SequenceDelimitation = 0xFFFEE0DD;
+const unsigned MaxNesting = 64;
+
+uint16_t read16(const uint8_t *p, bool bigEndian){
+	return bigEndian ? uint16_t(p[0] << 8 | p[1]) : uint16_t(p[1] << 8 | p[0]);
+}
+uint32_t read32(const uint8_t *p, bool bigEndian){
+	return bigEndian ?
+		uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3] :
+		uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0];
+}
+bool hasLongLength(const uint8_t *vr){
+	static const char *const long_vrs[]={"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"};
+	for(const char *l:long_vrs)
+		if(vr[0] == l[0] && vr[1] == l[1])
+			return true;
+	return false;
+}
+}
+
+constexpr DicomScanner::Tag DicomScanner::PixelData;
+
+DicomScanner::DicomScanner(std::vector<Tag> wanted):wanted(std::move(wanted))
+{
+	std::sort(this->wanted.begin(), this->wanted.end());
+	values.resize(this->wanted.size(), Value{nullptr, nullptr});
+	stop = this->wanted.empty() ? 0 : std::min(this->wanted.back() + 1, PixelData);
+}
+
+DicomScanner::Result DicomScanner::readHeader(const uint8_t *data, size_t size, size_t pos, const Encoding &enc, Element &el)
+{
+	if(size - pos < 8)
+		return Result::truncated;
+	const uint8_t *p = data + pos;
+	el.tag = makeTag(read16(p, enc.bigEndian), read16(p + 2, enc.bigEndian));
+	el.nestedImplicit = false;
+	if(el.tag >> 16 == 0xFFFE || !enc.explicitVR){ // items and delimiters never have a VR
+		el.length = read32(p + 4, enc.bigEndian);
+		el.value = pos + 8;
+	} else if(hasLongLength(p + 4)){
+		if(size - pos < 12)
+			return Result::truncated;
+		el.length = read32(p + 8, enc.bigEndian);
+		el.value = pos + 12;
+		el.nestedImplicit = p[4] == 'U' && p[5] == 'N'; // UN of undefined length is always implicit little endian inside
+	} else {
+		el.length = read16(p + 6, enc.bigEndian);
+		el.value = pos + 8;
+	}
+	return Result::end;
+}
+
+DicomScanner::Result DicomScanner::skipSequence(const uint8_t *data, size_t size, size_t &pos, Encoding enc, unsigned depth)
+{
+	if(depth > MaxNesting)
+		return Result::bad;
+	bool in_item = false;
+	for(;;){
+		Element el;
+		Result res = readHeader(data, size, pos, enc, el);
+		if(res != Result::end)
+			return res;
+		pos = el.value;
+		if(el.tag == SequenceDelimitation && !in_item)
+			return Result::end;
+		else if(el.tag == ItemDelimitation && in_item)
+			in_item = false;
+		else if(el.tag == Item && !in_item){
+			if(el.length == UndefinedLength)
+				in_item = true; // walk its elements until the item delimiter
+			else if(size - pos < el.length)
+				return Result::truncated;
+			else
+				pos += el.length;
+		} else if(in_item && el.tag >> 16 != 0xFFFE){
+			if(el.length == UndefinedLength){
+				Encoding inner = el.nestedImplicit ? Encoding{false, false} : enc;
+				res = skipSequence(data, size, pos, inner, depth + 1);
+				if(res != Result::end)
+					return res;
+			} else if(size - pos < el.length)
+				return Result::truncated;
+			else
+				pos += el.length;
+		} else
+			return Result::bad;
+	}
+}
+
+DicomScanner::Result DicomScanner::scanDataset(const uint8_t *data, size_t size, size_t pos, const Encoding &enc)
+{
+	std::fill(values.begin(), values.end(), Value{nullptr, nullptr});
+	size_t next_wanted = 0;
+	while(pos < size){
+		Element el;
+		Result res = readHeader(data, size, pos, enc, el);
+		if(res != Result::end)
+			return res;
+		if(el.tag >= stop){
+			stop_offset = pos;
+			return Result::stopped;
+		}
+		while(next_wanted < wanted.size() && wanted[next_wanted] < el.tag)
+			next_wanted++;
+
+		pos = el.value;
+		if(el.length == UndefinedLength){
+			res = skipSequence(data, size, pos, el.nestedImplicit ? Encoding{false, false} : enc, 0);
+			if(res != Result::end)
+				return res;
+		} else {
+			if(size - pos < el.length)
+				return Result::truncated;
+			if(next_wanted < wanted.size() && wanted[next_wanted] == el.tag){
+				const char *begin = reinterpret_cast<const char *>(data + pos), *end = begin + el.length;
+				end = std::find(begin, end, '\\'); // only the first value, like getOFString(ret,0)
+				while(begin < end && *begin == ' ')begin++;
+				while(end > begin && (end[-1] == ' ' || end[-1] == '\0'))end--;
+				values[next_wanted] = Value{begin, end};
+			}
+			pos += el.length;
+		}
+	}
+	stop_offset = size;
+	return Result::end;
+}
+
+bool DicomScanner::scanDeflated(const uint8_t *data, size_t size)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit2(&zs, -MAX_WBITS) != Z_OK) // raw deflate, no zlib header
+		return false;
+	zs.next_in = const_cast<Bytef *>(data);
+	zs.avail_in = uInt(std::min<size_t>(size, UINT32_MAX));
+
+	// inflate in growing steps and rescan after each one; headers are usually done after the first step
+	bool complete = false, good = false;
+	size_t produced = 0;
+	inflated.resize(64 * 1024);
+	for(;;){
+		zs.next_out = reinterpret_cast<Bytef *>(inflated.data() + produced);
+		zs.avail_out = uInt(inflated.size() - produced);
+		const int ret = inflate(&zs, Z_SYNC_FLUSH);
+		if(ret == Z_STREAM_END)
+			complete = true;
+		else if(ret != Z_OK && ret != Z_BUF_ERROR)
+			break;
+		produced = inflated.size() - zs.avail_out;
+
+		const Result res = scanDataset(reinterpret_cast<const uint8_t *>(inflated.data()), produced, 0, Encoding{true, false});
+		if(res == Result::stopped || (complete && res == Result::end)){
+			good = true;
+			break;
+		}
+		if(res == Result::bad || complete || (ret == Z_BUF_ERROR && zs.avail_in == 0))
+			break;
+		if(zs.avail_out == 0)
+			inflated.resize(inflated.size() * 2);
+	}
+	inflateEnd(&zs);
+	return good;
+}
+
+bool DicomScanner::scan(const void *buffer, size_t size)
+{
+	const uint8_t *data = static_cast<const uint8_t *>(buffer);
+	deflated = false;
+	if(size < 132 || memcmp(data + 128, "DICM", 4) != 0)
+		return false;
+
+	// meta header is always explicit VR little endian
+	const Encoding meta{true, false};
+	std::string syntax;
+	size_t pos = 132;
+	for(;;){
+		Element el;
+		if(readHeader(data, size, pos, meta, el) != Result::end || el.tag >> 16 != 0x0002)
+			break;
+		if(el.length == UndefinedLength || size - el.value < el.length)
+			return false;
+		if(el.tag == makeTag(0x0002, 0x0010)){
+			syntax.assign(reinterpret_cast<const char *>(data + el.value), el.length);
+			while(!syntax.empty() && (syntax.back() == '\0' || syntax.back() == ' '))
+				syntax.pop_back();
+		}
+		pos = el.value + el.length;
+	}
+
+	if(syntax == "1.2.840.10008.1.2.1.99"){
+		deflated = true;
+		return scanDeflated(data + pos, size - pos);
+	}
+
+	Encoding enc{true, false};
+	if(syntax == "1.2.840.10008.1.2")
+		enc.explicitVR = false;
+	else if(syntax == "1.2.840.10008.1.2.2")
+		enc.bigEndian = true;
+
+	const Result res = scanDataset(data, size, pos, enc);
+	return res == Result::stopped || res == Result::end;
+}
+
+bool DicomScanner::get(Tag tag, const char *&begin, const char *&end)const
+{
+	auto found = std::lower_bound(wanted.begin(), wanted.end(), tag);
+	if(found == wanted.end() || *found != tag)
+		return false;
+	const Value &v = values[found - wanted.begin()];
+	begin = v.begin;
+	end = v.end;
+	return v.begin != nullptr;
+}
+
+std::string DicomScanner::get(Tag tag)const
+{
+	const char *begin, *end;
+	if(get(tag, begin, end))
+		return std::string(begin, end);
+	else
+		return {};
+}
@@ -0,0 +1,56 @@
+#ifndef DICOMSCANNER_HPP
+#define DICOMSCANNER_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Forward-only scanner for the header of an encoded DICOM file.
+ * Unlike DicomHandle it never builds a dataset. It walks the top level elements until it passes the last wanted tag
+ * (or reaches PixelData) and remembers where the wanted values are. All other values, including nested sequences,
+ * are skipped without being copied.
+ * Explicit and implicit VR little endian, explicit VR big endian and deflated explicit VR little endian are supported.
+ * Anything else (e.g. files without the "DICM" preamble) makes scan() return false, so the caller can fall back to DCMTK.
+ */
+class DicomScanner
+{
+public:
+	typedef uint32_t Tag;
+	static constexpr Tag makeTag(uint16_t group, uint16_t element){return (Tag(group) << 16) | element;}
+	static constexpr Tag PixelData = 0x7FE00010;
+
+	explicit DicomScanner(std::vector<Tag> wanted);
+
+	/// scans the file in buffer, values found stay valid as long as buffer does
+	bool scan(const void *buffer, size_t size);
+
+	/// first value of tag with padding removed, empty if it was not found
+	std::string get(Tag tag)const;
+	bool get(Tag tag, const char *&begin, const char *&end)const;
+
+	/// offset (in buffer) of the first top level element after the wanted ones, or size if the dataset ended before
+	size_t stopOffset()const{return stop_offset;}
+	bool isDeflated()const{return deflated;}
+
+private:
+	enum class Result{stopped, end, truncated, bad};
+	struct Encoding{bool explicitVR, bigEndian;};
+	struct Element{Tag tag; uint32_t length; size_t value; bool nestedImplicit;};
+	struct Value{const char *begin, *end;};
+
+	std::vector<Tag> wanted;
+	std::vector<Value> values;
+	Tag stop;
+	size_t stop_offset=0;
+	bool deflated=false;
+	std::vector<char> inflated;
+
+	static Result readHeader(const uint8_t *data, size_t size, size_t pos, const Encoding &enc, Element &el);
+	static Result skipSequence(const uint8_t *data, size_t size, size_t &pos, Encoding enc, unsigned depth);
+	Result scanDataset(const uint8_t *data, size_t size, size_t pos, const Encoding &enc);
+	bool scanDeflated(const uint8_t *data, size_t size);
+};
+
+#endif //DICOMSCANNER_HPP
@@ -0,0 +1,42 @@
+#include "directorycache.hpp"
+#include <iterator>
+
+DirectoryCache::DirectoryCache(size_t max_size):max_size(max_size){}
+
+bool DirectoryCache::contains(const std::string &dir)
+{
+	bool found;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		found = known.count(dir) > 0;
+	}
+	(found ? hits : misses)++;
+	return found;
+}
+
+void DirectoryCache::insert(const std::string &dir)
+{
+	if(max_size == 0)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	if(known.count(dir))
+		return;
+	order.push_back(dir);
+	known.emplace(dir, std::prev(order.end()));
+	while(order.size() > max_size){
+		known.erase(order.front());
+		order.pop_front();
+	}
+}
+
+void DirectoryCache::erase(const std::string &dir)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = known.find(dir);
+	if(found == known.end())
+		return;
+	// from order as well, or a stale entry there could evict dir once it is inserted again
+	order.erase(found->second);
+	known.erase(found);
+	invalidations++;
+}
@@ -0,0 +1,30 @@
+#ifndef DIRECTORYCACHE_HPP
+#define DIRECTORYCACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Thread safe, bounded set of directories known to exist.
+ * Lets the shadow writer skip the stat/mkdir calls for directories it already created. When full, the oldest entries
+ * are forgotten first. Whoever deletes a directory must erase() it.
+ */
+class DirectoryCache
+{
+	std::mutex mutex;
+	std::list<std::string> order; // oldest first
+	std::unordered_map<std::string, std::list<std::string>::iterator> known;
+	const size_t max_size;
+public:
+	std::atomic<uint64_t> hits{0}, misses{0}, invalidations{0};
+
+	explicit DirectoryCache(size_t max_size);
+	bool contains(const std::string &dir);
+	void insert(const std::string &dir);
+	void erase(const std::string &dir);
+};
+
+#endif //DIRECTORYCACHE_HPP
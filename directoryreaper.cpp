@@ -0,0 +1,65 @@
+#include "directoryreaper.hpp"
+#include "shadowtree.hpp"
+
+DirectoryReaper::DirectoryReaper(std::chrono::milliseconds quiet):quiet(quiet), thread(&DirectoryReaper::run, this){}
+
+DirectoryReaper::~DirectoryReaper()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeup.notify_one();
+	thread.join();
+}
+
+void DirectoryReaper::add(const boost::filesystem::path &dir)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		last_added = std::chrono::steady_clock::now();
+		if(candidates.empty())
+			first_added = last_added;
+		candidates.insert(dir);
+	}
+	added++;
+	wakeup.notify_one();
+}
+
+void DirectoryReaper::reap(std::set<boost::filesystem::path> &batch)
+{
+	// paths sort before their children, so going from the back does children first and parents added on the way
+	// (which sort before the current one) are still to come
+	while(!batch.empty()){
+		const auto last = std::prev(batch.end());
+		const boost::filesystem::path dir = *last;
+		batch.erase(last);
+		checked++;
+		if(removeEmptyDir(dir)){
+			removed++;
+			batch.insert(dir.parent_path());
+		}
+	}
+}
+
+void DirectoryReaper::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;){
+		wakeup.wait(lock, [this]{return !candidates.empty() || stopping;});
+		if(!stopping){
+			// wait for things to calm down, but not forever
+			const auto deadline = first_added + quiet * 10;
+			while(!stopping && std::chrono::steady_clock::now() < std::min(last_added + quiet, deadline))
+				wakeup.wait_until(lock, std::min(last_added + quiet, deadline));
+		}
+
+		std::set<boost::filesystem::path> batch;
+		batch.swap(candidates);
+		lock.unlock();
+		reap(batch);
+		lock.lock();
+		if(stopping && candidates.empty())
+			return;
+	}
+}
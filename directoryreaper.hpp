@@ -0,0 +1,42 @@
+#ifndef DIRECTORYREAPER_HPP
+#define DIRECTORYREAPER_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
+/**
+ * Removes directories of the shadow tree that became empty, in batches in the background.
+ * remove() only hands in the directory it unlinked a shadow from. Once no new ones came in for "quiet" (or "quiet"
+ * times 10 passed since the first one of the batch), each distinct directory is tried once, deepest first, and the
+ * parents of those that could be removed join the same batch. So deleting a 5000 instance study costs one rmdir
+ * per directory instead of a walk up the tree per instance.
+ */
+class DirectoryReaper
+{
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::set<boost::filesystem::path> candidates;
+	std::chrono::steady_clock::time_point first_added, last_added;
+	const std::chrono::milliseconds quiet;
+	bool stopping=false;
+	std::thread thread;
+
+	void run();
+	void reap(std::set<boost::filesystem::path> &batch);
+public:
+	std::atomic<uint64_t> added{0}, checked{0}, removed{0};
+
+	explicit DirectoryReaper(std::chrono::milliseconds quiet);
+	DirectoryReaper(const DirectoryReaper &) = delete;
+	DirectoryReaper &operator=(const DirectoryReaper &) = delete;
+	/// reaps what is left before returning
+	~DirectoryReaper();
+	void add(const boost::filesystem::path &dir);
+};
+
+#endif //DIRECTORYREAPER_HPP
@@ -0,0 +1,49 @@
+#include "fileio.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+FileDescriptor::FileDescriptor(const char *path, int flags, mode_t mode):fd(open(path, flags | O_CLOEXEC, mode)){}
+FileDescriptor::~FileDescriptor()
+{
+	if(fd >= 0)
+		close(fd);
+}
+
+FileDescriptor openUntouched(const char *path)
+{
+	FileDescriptor file(path, O_RDONLY | O_NOATIME);
+	if(!file.good() && errno == EPERM) // O_NOATIME needs to own the file (or CAP_FOWNER)
+		return FileDescriptor(path, O_RDONLY);
+	return file;
+}
+
+ssize_t preadAll(int fd, void *buffer, size_t count, off_t offset)
+{
+	size_t done = 0;
+	while(done < count){
+		const ssize_t red = pread(fd, static_cast<char *>(buffer) + done, count - done, offset + done);
+		if(red < 0 && errno == EINTR)
+			continue;
+		if(red < 0)
+			return done ? ssize_t(done) : -1;
+		if(red == 0) // end of file
+			break;
+		done += red;
+	}
+	return done;
+}
+
+ssize_t pwriteAll(int fd, const void *buffer, size_t count, off_t offset)
+{
+	size_t done = 0;
+	while(done < count){
+		const ssize_t written = pwrite(fd, static_cast<const char *>(buffer) + done, count - done, offset + done);
+		if(written < 0 && errno == EINTR)
+			continue;
+		if(written <= 0)
+			return done ? ssize_t(done) : -1;
+		done += written;
+	}
+	return done;
+}
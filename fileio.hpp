@@ -0,0 +1,36 @@
+#ifndef FILEIO_HPP
+#define FILEIO_HPP
+
+#include <sys/types.h>
+#include <cstddef>
+#include <utility>
+
+/// owns a file descriptor and closes it when going out of scope
+class FileDescriptor
+{
+	int fd;
+public:
+	FileDescriptor():fd(-1){}
+	FileDescriptor(const char *path, int flags, mode_t mode = 0);
+	FileDescriptor(FileDescriptor &&other):fd(other.fd){other.fd = -1;}
+	/// the descriptor held before is closed by other
+	FileDescriptor &operator=(FileDescriptor &&other){std::swap(fd, other.fd); return *this;}
+	FileDescriptor(const FileDescriptor &) = delete;
+	FileDescriptor &operator=(const FileDescriptor &) = delete;
+	~FileDescriptor();
+	bool good()const{return fd >= 0;}
+	operator int()const{return fd;}
+};
+
+/// opens path for reading without updating its access time (which the tier migration goes by), if we may
+FileDescriptor openUntouched(const char *path);
+
+/**
+ * pread()/pwrite() until count bytes are done, the file ends or an error happens.
+ * Interrupted calls are restarted and short transfers are continued.
+ * Returns the number of bytes transferred, or -1 (with errno set) if nothing could be transferred because of an error.
+ */
+ssize_t preadAll(int fd, void *buffer, size_t count, off_t offset);
+ssize_t pwriteAll(int fd, const void *buffer, size_t count, off_t offset);
+
+#endif //FILEIO_HPP
@@ -0,0 +1,124 @@
+#include "filemove.hpp"
+#include "shadowtree.hpp"
+#include "fileio.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+namespace {
+/// copies our extended attributes (shadow index, checksum, ...)
+void copyAttributes(int in, int out)
+{
+	std::vector<char> names(4096), value(4096);
+	const ssize_t len = flistxattr(in, names.data(), names.size());
+	for(ssize_t pos = 0; pos < len; pos += strlen(&names[pos]) + 1){
+		const char *name = &names[pos];
+		if(strncmp(name, "user.shadowwriter.", 18))
+			continue;
+		const ssize_t size = fgetxattr(in, name, value.data(), value.size());
+		if(size >= 0)
+			fsetxattr(out, name, value.data(), size, 0);
+	}
+}
+
+bool copy(const fs::path &src, const fs::path &dst, const struct stat &st, Throttle *throttle, const std::atomic<bool> *cancelled)
+{
+	const fs::path tmp = dst.native() + ".tmp";
+	FileDescriptor in(src.c_str(), O_RDONLY), out(tmp.c_str(), O_CREAT | O_TRUNC | O_WRONLY, DEFFILEMODE);
+	if(!in.good() || !out.good()){
+		OrthancPlugins::LogError(std::string("Failed to copy \"") + src.native() + "\" to \"" + tmp.native() + "\" " + strerror(errno));
+		return false;
+	}
+	std::vector<char> buffer(1 << 20);
+	for(off_t offset = 0; offset < st.st_size;){
+		const size_t want = std::min<off_t>(buffer.size(), st.st_size - offset);
+		if(throttle)
+			throttle->acquire(want);
+		if(cancelled && *cancelled){
+			unlink(tmp.c_str());
+			return false;
+		}
+		if(preadAll(in, buffer.data(), want, offset) < ssize_t(want) || pwriteAll(out, buffer.data(), want, offset) < ssize_t(want)){
+			OrthancPlugins::LogError(std::string("Failed to copy \"") + src.native() + "\" to \"" + tmp.native() + "\" " + strerror(errno));
+			unlink(tmp.c_str());
+			return false;
+		}
+		offset += want;
+	}
+	copyAttributes(in, out);
+	const struct timespec times[2] = {st.st_atim, st.st_mtim}; // keep the access age (e.g. for the next tier)
+	futimens(out, times);
+	if(fsync(out) || rename(tmp.c_str(), dst.c_str())){
+		OrthancPlugins::LogError(std::string("Failed to store \"") + dst.native() + "\" " + strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+	}
+	// the new name has to be on disk before the old file goes
+	FileDescriptor dir(dst.parent_path().c_str(), O_RDONLY | O_DIRECTORY);
+	if(dir.good())
+		fsync(dir);
+	return true;
+}
+}
+
+int64_t moveOriginal(const fs::path &src, const fs::path &dst, Throttle *throttle, const std::atomic<bool> *cancelled)
+{
+	if(!makeDirectory(dst.parent_path()))
+		return -1;
+	if(rename(src.c_str(), dst.c_str()) == 0)
+		return 0;
+	if(errno != EXDEV){
+		if(errno != ENOENT) // ENOENT is removed meanwhile
+			OrthancPlugins::LogError(std::string("Failed to move \"") + src.native() + "\" to \"" + dst.native() + "\" " + strerror(errno));
+		return -1;
+	}
+
+	struct stat st, existing;
+	if(stat(src.c_str(), &st))
+		return -1;
+	boost::system::error_code ec;
+	fs::path shadow = shadow_index.lookup(src);
+	const bool indexed = !shadow.empty();
+	if(!indexed && st.st_nlink > 1) // not indexed (e.g. stored before there was an index), its hardlink has to be found from the file
+		shadow = GetSPathFromFile(src);
+	const bool linked = !shadow.empty() && fs::equivalent(shadow, src, ec);
+	if(st.st_nlink > (linked ? 2u : 1u)){
+		OrthancPlugins::LogWarning(std::string("Not moving \"") + src.native() + "\" to another device, it has other hardlinks");
+		return -1;
+	}
+	// an interrupted move may have left a complete copy already
+	if(stat(dst.c_str(), &existing) && !copy(src, dst, st, throttle, cancelled))
+		return -1;
+	if(linked && !indexed)
+		shadow_index.store(dst, shadow);
+
+	if(linked){
+		// replace the shadow in one go, a hardlink can't cross devices so it may become a symlink
+		const fs::path tmp = shadow.native() + ".tmp";
+		unlink(tmp.c_str());
+		int erg = link(dst.c_str(), tmp.c_str());
+		if(erg && errno == EXDEV)
+			erg = symlink(fs::absolute(dst).c_str(), tmp.c_str());
+		if(erg || rename(tmp.c_str(), shadow.c_str())){
+			OrthancPlugins::LogWarning(std::string("Failed to re-point shadow \"") + shadow.native() + "\" to \"" + dst.native() + "\" " + strerror(errno));
+			unlink(tmp.c_str());
+			return -1; // the next attempt tries again, the copy is already there then
+		}
+	}
+
+	if(unlink(src.c_str()) == 0)
+		return st.st_size;
+	if(errno == ENOENT){ // removed from Orthanc while we were at it
+		if(linked && fs::equivalent(shadow, dst, ec))
+			unlink(shadow.c_str());
+		unlink(dst.c_str());
+	} else
+		OrthancPlugins::LogWarning(std::string("Failed to remove \"") + src.native() + "\" after moving it to \"" + dst.native() + "\" " + strerror(errno));
+	return -1;
+}
@@ -0,0 +1,22 @@
+#ifndef FILEMOVE_HPP
+#define FILEMOVE_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include "throttle.hpp"
+
+/**
+ * Moves the stored file src to dst (another storage tier or layout), creating the directory of dst if needed.
+ * On the same filesystem that's a rename, which takes the shadow (a hardlink) and the extended attributes along.
+ * Otherwise the copy only gets its name once it was synced, then the shadow is re-pointed (as symlink) and only then is
+ * src removed. If that's interrupted src is still there and in use, and the next attempt picks up the finished copy.
+ * Copying is paced by throttle (in bytes) and given up once cancelled is set, if they are given. Files with other
+ * hardlinks than their shadow (deduplicated ones) are not copied, as that would split them.
+ * Returns the number of bytes copied (0 for a rename) or -1 if src was not moved (or was removed meanwhile).
+ */
+int64_t moveOriginal(
+	const boost::filesystem::path &src, const boost::filesystem::path &dst,
+	Throttle *throttle = nullptr, const std::atomic<bool> *cancelled = nullptr
+);
+
+#endif //FILEMOVE_HPP
@@ -0,0 +1,139 @@
+#include "groupcommit.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include "fileio.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <memory>
+#include <set>
+#include <unistd.h>
+#include <cstring>
+
+namespace fs = boost::filesystem;
+
+GroupCommit::GroupCommit(std::chrono::milliseconds window):window(window), thread(&GroupCommit::run, this){}
+
+GroupCommit::~GroupCommit()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cancelled = true;
+	wake.notify_all();
+	thread.join();
+	if(cleaner.joinable())
+		cleaner.join();
+}
+
+std::future<bool> GroupCommit::commit(FileDescriptor file, fs::path tmp, fs::path dest)
+{
+	Entry entry{std::move(file), std::move(tmp), std::move(dest), std::promise<bool>()};
+	std::future<bool> ret = entry.done.get_future();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(std::move(entry));
+	}
+	wake.notify_all();
+	return ret;
+}
+
+bool GroupCommit::syncDirectories(const std::vector<Entry> &batch)
+{
+	// not syncfs(), that flushes everything else on the filesystem too and reports writeback errors only since Linux 5.8
+	std::set<fs::path> done;
+	for(const Entry &e:batch){
+		const fs::path dir = e.dest.parent_path();
+		if(!done.insert(dir).second)
+			continue;
+		FileDescriptor fd(dir.c_str(), O_RDONLY | O_DIRECTORY);
+		if(!fd.good() || fsync(fd)){
+			OrthancPlugins::LogError(std::string("Failed to flush \"") + dir.native() + "\" " + strerror(errno));
+			return false;
+		}
+	}
+	return true;
+}
+
+void GroupCommit::flush(std::vector<Entry> &batch)
+{
+	batches++;
+	std::vector<bool> renamed(batch.size(), false);
+	for(size_t i = 0; i < batch.size(); i++){
+		const Entry &e = batch[i];
+		// the writers started the writeback already, so this mostly waits for what's on its way
+		if(e.file.good() && fdatasync(e.file))
+			OrthancPlugins::LogError(std::string("Failed to flush \"") + e.tmp.native() + "\" " + strerror(errno));
+		else if(rename(e.tmp.c_str(), e.dest.c_str()) == 0){
+			renamed[i] = true;
+			continue;
+		} else
+			OrthancPlugins::LogError(
+				std::string("Failed to rename \"") + e.tmp.native() + "\" to \"" + e.dest.native() + "\" " + strerror(errno));
+		unlink(e.tmp.c_str());
+	}
+	const bool published = syncDirectories(batch); // the new names
+	for(size_t i = 0; i < batch.size(); i++){
+		if(renamed[i] && !published)
+			unlink(batch[i].dest.c_str()); // we can't vouch for it, so better have the write fail
+		if(renamed[i] && published)
+			files++;
+		batch[i].done.set_value(renamed[i] && published);
+	}
+}
+
+void GroupCommit::removeLeftovers(std::vector<fs::path> roots)
+{
+	if(!cleaner.joinable())
+		cleaner = std::thread(&GroupCommit::clean, this, std::move(roots), std::time(nullptr));
+}
+
+void GroupCommit::clean(const std::vector<fs::path> &roots, std::time_t before)
+{
+	for(const fs::path &root:roots)
+		if(!cleanDirectory(root, before))
+			OrthancPlugins::LogWarning("Failed to look for leftover temporary files in \"" + root.native() + "\" " + strerror(errno));
+	if(leftovers)
+		OrthancPlugins::LogWarning("Removed " + std::to_string(leftovers) + " temporary files left by interrupted writes");
+}
+
+bool GroupCommit::cleanDirectory(const fs::path &dir, std::time_t before)
+{
+	const size_t TmpNameSize = 36 + 4; // <uuid>.tmp
+	// readdir instead of a directory iterator, files renamed by the commits meanwhile must not end the walk
+	std::unique_ptr<DIR, int(*)(DIR *)> entries(opendir(dir.c_str()), closedir);
+	if(!entries)
+		return false;
+	while(const dirent *entry = readdir(entries.get())){
+		if(cancelled)
+			return true;
+		const std::string name = entry->d_name;
+		if(name == "." || name == "..")
+			continue;
+		const fs::path path = dir / name;
+		struct stat st;
+		if(entry->d_type == DT_DIR || (entry->d_type == DT_UNKNOWN && lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)))
+			cleanDirectory(path, before);
+		else if(name.size() == TmpNameSize && path.extension() == ".tmp" && lstat(path.c_str(), &st) == 0 &&
+			S_ISREG(st.st_mode) && st.st_mtime < before && unlink(path.c_str()) == 0) // newer ones are being written right now
+			leftovers++;
+	}
+	return true;
+}
+
+void GroupCommit::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		wake.wait(lock, [this]{return stop || !pending.empty();});
+		if(pending.empty())
+			return; // stopped, and nothing left
+		// give concurrent writers the chance to join this batch
+		wake.wait_for(lock, window, [this]{return stop;});
+		std::vector<Entry> batch;
+		batch.swap(pending);
+		lock.unlock();
+		flush(batch);
+		lock.lock();
+	}
+}
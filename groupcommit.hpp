@@ -0,0 +1,56 @@
+#ifndef GROUPCOMMIT_HPP
+#define GROUPCOMMIT_HPP
+
+#include "fileio.hpp"
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Makes freshly written files durable in batches.
+ * Writers hand in a completely written temporary file, still open, with the name it should get. A background thread
+ * collects what comes in during the latency window, flushes the files (fdatasync on the descriptors they were written
+ * with, so writeback errors are seen), renames them into place and flushes each directory involved once, so the new
+ * names are on disk as well. Only then are the writers told about it.
+ * So after a crash a file is either complete under its final name, or not there at all (but maybe as temporary file,
+ * which removeLeftovers() cleans up on the next start).
+ */
+class GroupCommit
+{
+	struct Entry{
+		FileDescriptor file; // not good for files that are already on disk (e.g. new links to them)
+		boost::filesystem::path tmp, dest;
+		std::promise<bool> done;
+	};
+	const std::chrono::milliseconds window;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<Entry> pending;
+	bool stop=false;
+	std::atomic<bool> cancelled{false}; // for the cleaner
+	std::thread thread, cleaner;
+
+	bool syncDirectories(const std::vector<Entry> &batch);
+	void clean(const std::vector<boost::filesystem::path> &roots, std::time_t before);
+	bool cleanDirectory(const boost::filesystem::path &dir, std::time_t before);
+	void flush(std::vector<Entry> &batch);
+	void run();
+public:
+	std::atomic<uint64_t> batches{0}, files{0}, leftovers{0};
+
+	explicit GroupCommit(std::chrono::milliseconds window);
+	/// publishes everything still pending
+	~GroupCommit();
+	/// flushes file (written as tmp), renames tmp to dest and flushes the directory, the future is false if anything went wrong (tmp is gone then)
+	std::future<bool> commit(FileDescriptor file, boost::filesystem::path tmp, boost::filesystem::path dest);
+	/// removes the temporary files (<uuid>.tmp) older than now below roots in the background, they are from writes a crash interrupted
+	void removeLeftovers(std::vector<boost::filesystem::path> roots);
+};
+
+#endif //GROUPCOMMIT_HPP
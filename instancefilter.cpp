@@ -1,16 +1,21 @@
 #include "OrthancPluginCppWrapper.h"
 #include <openssl/md5.h>
 #include <string>
+#include <cctype>
 #include <memory>
+#include <thread>
 #include <jsoncpp/json/reader.h>
-#include <regex>
 
 #include "patientnamemapping.hpp"
 #include "tagprocessorlist.hpp"
 #include "dicomhandle.hpp"
+#include "patientfields.hpp"
+#include "verdictcache.hpp"
+#include "reprocess.hpp"
 
 std::unique_ptr<PatientNameMapping> patient_name_map;
 std::unique_ptr<TagProcessorList> tag_processor_list;
+std::unique_ptr<VerdictCache> verdicts;
 
 struct OrthancPluginString{
 	char *begin,*end;
@@ -22,20 +27,22 @@ struct OrthancPluginString{
 	}
 };
 
+/// matches "[0-9]{5}\.[0-9a-f]{2}.*" (case insensitive), id and checksum are set to the two groups
 bool isSubjectID(const std::string& text, std::string &id, std::string &checksum){
-	std::smatch result;
-	static std::regex isPatientID(
-		"([0-9]{5})\\.([0-9a-f]{2}).*",
-		std::regex_constants::ECMAScript|std::regex_constants::optimize|std::regex_constants::icase
-	);
-	if(std::regex_match(text,result,isPatientID)){
-		id=result[1],checksum=result[2];
-		return true;
-	}
-	return false;
+	if(text.size()<8 || text[5]!='.')
+		return false;
+	for(size_t i=0;i<5;i++)
+		if(!isdigit(static_cast<unsigned char>(text[i])))
+			return false;
+	for(size_t i=6;i<8;i++)
+		if(!isxdigit(static_cast<unsigned char>(text[i])))
+			return false;
+	id.assign(text,0,5);
+	checksum.assign(text,6,2);
+	return true;
 }
 
-bool checkSubjectID(const std::string& wholeID){
+bool verifySubjectID(const std::string& wholeID){
 	std::string id,checksum;
 
 	// if its no subjectID ignore it
@@ -51,26 +58,38 @@ bool checkSubjectID(const std::string& wholeID){
 		return true;
 
 	//last resort, check for known good IDs
-	if(patient_name_map->knownValue(wholeID))
-		return true;
+	return patient_name_map->knownValue(wholeID);
+}
 
-	OrthancPlugins::LogWarning(wholeID+ " was not found in list of known PatientIDs");
-	return false;
+bool checkSubjectID(const std::string& wholeID){
+	// all instances of a series come with the same ID, so the verdict is remembered until the mapping is reloaded
+	const uint64_t generation=patient_name_map->generation;
+	bool good;
+	if(!verdicts->find(wholeID,generation,good)){
+		good=verifySubjectID(wholeID);
+		verdicts->insert(wholeID,generation,good);
+	}
+	if(!good)
+		OrthancPlugins::LogWarning(wholeID+ " was not found in list of known PatientIDs");
+	return good;
 }
 
-bool MapPatient(DicomHandle& dcmfile){
+/// changed is set if PatientName or PatientID was replaced
+bool MapPatient(DicomHandle& dcmfile, bool &changed){
 	bool good=true;
 	const auto patName = dcmfile.findString(DcmTagKey(0x0010, 0x0010));
 	const auto patID = dcmfile.findString(DcmTagKey(0x0010, 0x0020));
 	auto found_patName=patient_name_map->lookup(patName);
 	auto found_patID=patient_name_map->lookup(patID);
 
-	if(!found_patName.empty()){
+	if(!found_patName.empty() && found_patName!=patName){
 		good &= dcmfile.replaceString(DcmTagKey(0x0010, 0x0010),found_patName);
+		changed=true;
 	}
 
-	if(!found_patID.empty()){
+	if(!found_patID.empty() && found_patID!=patID){
 		good &= dcmfile.replaceString(DcmTagKey(0x0010, 0x0020),found_patID);
+		changed=true;
 	}
 
 	return good;
@@ -78,43 +97,150 @@ bool MapPatient(DicomHandle& dcmfile){
 
 
 int32_t instanceFilter(const OrthancPluginDicomInstance *instance){
-	static const std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
-	OrthancPluginString string(OrthancPluginGetInstanceSimplifiedJson(OrthancPlugins::GetGlobalContext(), instance));
-	Json::Value root;
-	std::string errs;
+	PatientFields fields;
+	const void *data=OrthancPluginGetInstanceData(OrthancPlugins::GetGlobalContext(), instance);
+	const uint64_t size=OrthancPluginGetInstanceSize(OrthancPlugins::GetGlobalContext(), instance);
+	if(!fields.fromFile(data,size)){
+		// slow path for files the DicomScanner can't handle, lets the core decode the instance
+		OrthancPluginString json(OrthancPluginGetInstanceSimplifiedJson(OrthancPlugins::GetGlobalContext(), instance));
+		fields.fromJson(json.begin,json.end);
+	}
 
-	reader->parse(string.begin,string.end,&root,&errs);
-	if(root.isMember("PatientID") && !checkSubjectID(root["PatientID"].asString()))
+	if(fields.has_id && !checkSubjectID(fields.id))
 		return -1; // this will be interpreted as corrupt file by orthanc an thus the scp-store will be rejected
 
-	if(root.isMember("PatientName") && !checkSubjectID(root["PatientName"].asString()))
-			return -1; // this will be interpreted as corrupt file by orthanc an thus the scp-store will be rejected
+	if(fields.has_name && !checkSubjectID(fields.name))
+		return -1;
 
 	return 1; //0 to discard the instance, 1 to store the instance, -1 if error.
 }
 
-OrthancPluginErrorCode transcoder(OrthancPluginMemoryBuffer *target, const void *buffer, uint64_t size, const char *const *allowedSyntaxes, uint32_t countSyntaxes, uint8_t allowNewSopInstanceUid)
+/// the PatientName mapping and "ProcessTags", changed is set if anything was changed
+bool processInstance(DicomHandle& dcmfile, bool &changed){
+	if(!MapPatient(dcmfile,changed)){
+		OrthancPlugins::LogError("PatientID mapping failed");
+		return false;
+	}
+	changed |= tag_processor_list->FixTags(dcmfile.getDataset());
+	return true;
+}
+
+#if ORTHANC_PLUGINS_VERSION_IS_ABOVE(1, 10, 0)
+/// maps the patient and applies "ProcessTags" before the instance is stored for the first time
+OrthancPluginReceivedInstanceAction receivedInstance(OrthancPluginMemoryBuffer64 *modified, const void *buffer, uint64_t size, OrthancPluginInstanceOrigin /*origin*/)
 {
-	DicomHandle dcmfile(buffer,size);
+	if(Reprocess::storing) // processed already
+		return OrthancPluginReceivedInstanceAction_KeepAsIs;
 
+	// only the header is decoded, unless a rule changes the pixel data
+	DicomHandle dcmfile(buffer,size,!tag_processor_list->touchesPixelData());
 	if(!dcmfile.valid){
 		OrthancPlugins::LogError("Instance filter failed to load dicom data");
-		return OrthancPluginErrorCode_BadFileFormat;
+		return OrthancPluginReceivedInstanceAction_KeepAsIs; // it's up to the core to reject it
 	}
 
-	if(!MapPatient(dcmfile))	{
-		OrthancPlugins::LogError("PatientID mapping failed");
-		return OrthancPluginErrorCode_BadFileFormat;
+	bool changed=false;
+	if(!processInstance(dcmfile,changed))
+		return OrthancPluginReceivedInstanceAction_Discard;
+	if(!changed)
+		return OrthancPluginReceivedInstanceAction_KeepAsIs;
+
+	if(!dcmfile.SaveToMemoryBuffer(modified)){
+		OrthancPlugins::LogError("Failed to write processed instance");
+		return OrthancPluginReceivedInstanceAction_Discard;
 	}
+	return OrthancPluginReceivedInstanceAction_Modify;
+}
+#endif
 
-	tag_processor_list->FixTags(dcmfile.getDataset());
+void getStatistics(OrthancPluginRestOutput* output, const char* /*url*/, const OrthancPluginHttpRequest* request){
+	if(request->method != OrthancPluginHttpMethod_Get){
+		OrthancPlugins::AnswerMethodNotAllowed(output, "GET");
+		return;
+	}
+	Json::Value ret;
+	Json::Value &cache=ret["SubjectIDCache"];
+	cache["Hits"]=Json::UInt64(verdicts->hits);
+	cache["Misses"]=Json::UInt64(verdicts->misses);
+	cache["Invalidations"]=Json::UInt64(verdicts->invalidations);
+	const uint64_t lookups=verdicts->hits+verdicts->misses;
+	cache["HitRate"]=lookups ? double(verdicts->hits)/lookups : 0.;
+	OrthancPlugins::AnswerJson(ret, output);
+}
 
-	if(dcmfile.SaveToMemoryBuffer(target))
-		return OrthancPluginErrorCode::OrthancPluginErrorCode_Success; //0 if success (i.e. image successfully target and stored into "target"), or the error code if failure.
-	else
-		return OrthancPluginErrorCode_BadFileFormat;
+bool parsePost(OrthancPluginRestOutput* output, const OrthancPluginHttpRequest* request, Json::Value &body){
+	if(request->method != OrthancPluginHttpMethod_Post){
+		OrthancPlugins::AnswerMethodNotAllowed(output, "POST");
+		return false;
+	}
+	if(request->bodySize){
+		static const std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+		const char *begin=static_cast<const char*>(request->body);
+		std::string errs;
+		if(!reader->parse(begin,begin+request->bodySize,&body,&errs)){
+			OrthancPlugins::AnswerHttpError(400, output);
+			return false;
+		}
+	}
+	return true;
 }
 
+/// runs Reprocess as Orthanc job, so it shows up in /jobs and can be paused or canceled there
+class ReprocessJob:public OrthancPlugins::OrthancJob{
+	const std::vector<std::string> patients, studies;
+	const unsigned threads, max_io;
+	std::unique_ptr<Reprocess> reprocess;
+	void update(){
+		Json::Value content;
+		content["Instances"]=Json::UInt64(reprocess->files);
+		content["Changed"]=Json::UInt64(reprocess->changed);
+		content["Unchanged"]=Json::UInt64(reprocess->unchanged);
+		content["Errors"]=Json::UInt64(reprocess->errors);
+		Json::Value &timings=content["Timings"]; // in ms summed over all threads
+		timings["Fetch"]=Json::UInt64(reprocess->fetch_us/1000);
+		timings["Parse"]=Json::UInt64(reprocess->parse_us/1000);
+		timings["Process"]=Json::UInt64(reprocess->process_us/1000);
+		timings["Encode"]=Json::UInt64(reprocess->encode_us/1000);
+		timings["Store"]=Json::UInt64(reprocess->store_us/1000);
+		UpdateContent(content);
+		UpdateProgress(reprocess->progress());
+	}
+public:
+	ReprocessJob(std::vector<std::string> patients, std::vector<std::string> studies, unsigned threads, unsigned max_io):
+		OrthancJob("Reprocess"),patients(std::move(patients)),studies(std::move(studies)),threads(threads),max_io(max_io){Reset();}
+	OrthancPluginJobStepStatus Step() override{
+		const bool more=reprocess->step();
+		update();
+		return more ? OrthancPluginJobStepStatus_Continue : OrthancPluginJobStepStatus_Success;
+	}
+	void Stop(OrthancPluginJobStopReason) override{reprocess->cancel();}
+	void Reset() override{
+		reprocess.reset(new Reprocess(patients,studies,threads,max_io,processInstance,!tag_processor_list->touchesPixelData()));
+		update();
+	}
+};
+/**
+ * Applies the PatientName mapping and "ProcessTags" again to stored instances, with a body like
+ * {"Patients":[...], "Studies":[...], "Threads":8, "MaxConcurrentIO":2} (Orthanc IDs, Threads defaults to the number of cores)
+ * Instances that keep their ID are replaced in place, which needs "OverwriteInstances", otherwise they fail.
+ */
+void postReprocess(OrthancPluginRestOutput* output, const char* /*url*/, const OrthancPluginHttpRequest* request){
+	Json::Value body;
+	if(!parsePost(output, request, body))
+		return;
+	std::vector<std::string> patients, studies;
+	for(const Json::Value &id:body["Patients"])
+		patients.push_back(id.asString());
+	for(const Json::Value &id:body["Studies"])
+		studies.push_back(id.asString());
+	const unsigned threads=body.get("Threads",std::thread::hardware_concurrency()).asUInt();
+	const unsigned max_io=body.get("MaxConcurrentIO",2).asUInt();
+
+	Json::Value answer;
+	answer["ID"]=OrthancPlugins::OrthancJob::Submit(new ReprocessJob(patients,studies,threads,max_io),0);
+	answer["Path"]="/jobs/"+answer["ID"].asString();
+	OrthancPlugins::AnswerJson(answer, output);
+}
 
 extern "C"
 {
@@ -135,15 +261,26 @@ ORTHANC_PLUGINS_API int32_t OrthancPluginInitialize(OrthancPluginContext* c)
 	OrthancPlugins::OrthancConfiguration patient_map_cfg,tag_processing_cfg;
 	OrthancPlugins::OrthancConfiguration().GetSection(patient_map_cfg,"PatientIDMap");
 	patient_name_map.reset(new PatientNameMapping(patient_map_cfg));
+	verdicts.reset(new VerdictCache(OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("SubjectIDCacheSize",10000)));
 
 	//setting up filter for incoming instances (this does not change data, only accepts or rejects them)
 	OrthancPluginRegisterIncomingDicomInstanceFilter(c,instanceFilter);
-
-	//doesn't work, as the callback is only called when image is transcoded by Orthanc
-	//setup up tag processing mapping
-//	OrthancPlugins::OrthancConfiguration().GetSection(tag_processing_cfg,"ProcessTags");
-//	tag_processor_list.reset(new TagProcessorList(tag_processing_cfg));
-//	OrthancPluginRegisterTranscoderCallback(c,transcoder);
+	OrthancPlugins::RegisterRestCallback<getStatistics>("/instancefilter/statistics", true);
+	OrthancPlugins::RegisterRestCallback<postReprocess>("/instancefilter/reprocess", true);
+	if(!OrthancPlugins::OrthancConfiguration().GetBooleanValue("OverwriteInstances",false))
+		OrthancPlugins::LogWarning("\"OverwriteInstances\" is false, /instancefilter/reprocess can only replace instances whose patient changes");
+
+	//setup up tag processing mapping, it's applied (with the PatientName mapping) to every received instance before it's stored
+	OrthancPlugins::OrthancConfiguration().GetSection(tag_processing_cfg,"ProcessTags");
+	tag_processor_list.reset(new TagProcessorList(tag_processing_cfg));
+#if ORTHANC_PLUGINS_VERSION_IS_ABOVE(1, 10, 0)
+	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("RewriteReceivedInstances",true)){
+		if(OrthancPluginCheckVersionAdvanced(c, 1, 10, 0))
+			OrthancPluginRegisterReceivedInstanceCallback(c,receivedInstance);
+		else
+			OrthancPlugins::LogError("Rewriting received instances needs Orthanc 1.10.0 or newer, \"ProcessTags\" won't be applied");
+	}
+#endif
 
 	return 0;
 }
@@ -151,6 +288,7 @@ ORTHANC_PLUGINS_API int32_t OrthancPluginInitialize(OrthancPluginContext* c)
 ORTHANC_PLUGINS_API void OrthancPluginFinalize(){
 	patient_name_map.reset();
 	tag_processor_list.reset();
+	verdicts.reset();
 }
 ORTHANC_PLUGINS_API const char* OrthancPluginGetName()
 {
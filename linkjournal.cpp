@@ -0,0 +1,65 @@
+#include "linkjournal.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <unistd.h>
+#include <fstream>
+#include <set>
+
+LinkJournal::LinkJournal(boost::filesystem::path filename):filename(std::move(filename)){}
+
+LinkJournal::~LinkJournal()
+{
+	if(fd >= 0)
+		close(fd);
+}
+
+std::vector<std::string> LinkJournal::open()
+{
+	std::set<std::string> leftover;
+	std::ifstream in(filename.c_str());
+	std::string line;
+	while(std::getline(in, line)){
+		if(line.size() < 2)
+			continue;
+		if(line[0] == '+')
+			leftover.insert(line.substr(1));
+		else if(line[0] == '-')
+			leftover.erase(line.substr(1));
+	}
+
+	// the leftovers will be queued again by the caller, which writes them back into the journal
+	fd = ::open(filename.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_APPEND | O_CLOEXEC, DEFFILEMODE);
+	if(fd < 0)
+		OrthancPlugins::LogError(
+			std::string("Failed to open link journal \"") + filename.native() + "\" " + strerror(errno) +
+			", pending links will not survive a crash");
+	return std::vector<std::string>(leftover.begin(), leftover.end());
+}
+
+void LinkJournal::append(char op, const std::string &uuid)
+{
+	if(fd < 0)
+		return;
+	const std::string line = op + uuid + '\n';
+	if(write(fd, line.data(), line.size()) != ssize_t(line.size()))
+		OrthancPlugins::LogWarning(std::string("Failed to write to link journal \"") + filename.native() + "\" " + strerror(errno));
+}
+
+void LinkJournal::begin(const std::string &uuid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	append('+', uuid);
+	pending++;
+}
+
+void LinkJournal::end(const std::string &uuid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(--pending == 0 && fd >= 0){ // nothing left to replay, start over
+		if(ftruncate(fd, 0))
+			append('-', uuid);
+	} else
+		append('-', uuid);
+}
@@ -0,0 +1,34 @@
+#ifndef LINKJOURNAL_HPP
+#define LINKJOURNAL_HPP
+
+#include <boost/filesystem.hpp>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Small append-only journal of shadow links that were queued but not yet created.
+ * Every queued link appends "+<uuid>", every finished one "-<uuid>". Whenever nothing is pending the file is truncated,
+ * so it stays tiny. What is left in it after a crash is handed out by open() to be replayed.
+ * It is never fsynced (that would cost a flush per stored instance), so it only covers a crash of the process.
+ */
+class LinkJournal
+{
+	std::mutex mutex;
+	boost::filesystem::path filename;
+	int fd=-1;
+	size_t pending=0;
+	void append(char op, const std::string &uuid);
+public:
+	explicit LinkJournal(boost::filesystem::path filename);
+	LinkJournal(const LinkJournal &) = delete;
+	LinkJournal &operator=(const LinkJournal &) = delete;
+	~LinkJournal();
+
+	/// opens the journal, returns the uuids left pending by the last run and starts over with an empty journal
+	std::vector<std::string> open();
+	void begin(const std::string &uuid);
+	void end(const std::string &uuid);
+};
+
+#endif //LINKJOURNAL_HPP
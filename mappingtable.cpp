@@ -0,0 +1,170 @@
+#include "mappingtable.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+const char MappingTable::Magic[8]={'P','N','M','A','P','\0','\0','\1'};
+
+MappingTable::~MappingTable()
+{
+	if(mapped)
+		munmap(mapped, mapped_size);
+}
+
+bool MappingTable::isCompiled(const boost::filesystem::path &filename)
+{
+	char magic[sizeof(Magic)];
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	return in.read(magic, sizeof(magic)) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+bool MappingTable::open(const boost::filesystem::path &filename)
+{
+	const int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0){
+		OrthancPlugins::LogError(std::string("Failed to open compiled mapping \"") + filename.native() + "\" (" + strerror(errno) + ")");
+		if(fd >= 0)
+			close(fd);
+		return false;
+	}
+	mapped_size = st.st_size;
+	mapped = mapped_size >= sizeof(Header) ? mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if(mapped == MAP_FAILED){
+		mapped = nullptr;
+		OrthancPlugins::LogError(std::string("Failed to map compiled mapping \"") + filename.native() + "\"");
+		return false;
+	}
+
+	// only the sizes are checked here, offsets are checked when they are used, so nothing needs to be read in advance
+	const Header *head = static_cast<const Header *>(mapped);
+	const uint64_t tables = head->count * (sizeof(Entry) + 2 * sizeof(uint32_t));
+	if(memcmp(head->magic, Magic, sizeof(Magic)) != 0 || head->count > UINT32_MAX ||
+		mapped_size != sizeof(Header) + tables + head->strings){
+		OrthancPlugins::LogError(std::string("\"") + filename.native() + "\" is not a valid compiled mapping");
+		return false;
+	}
+	header = head;
+	entries = reinterpret_cast<const Entry *>(header + 1);
+	by_left = reinterpret_cast<const uint32_t *>(entries + header->count);
+	by_right = by_left + header->count;
+	strings = reinterpret_cast<const char *>(by_right + header->count);
+	madvise(mapped, mapped_size, MADV_RANDOM);
+	return true;
+}
+
+bool MappingTable::column(const Entry &entry, bool right, const char *&begin, size_t &size)const
+{
+	const uint64_t offset = right ? entry.right : entry.left;
+	size = right ? entry.right_size : entry.left_size;
+	if(offset + size > header->strings)
+		return false;
+	begin = strings + offset;
+	return true;
+}
+
+void MappingTable::equalRange(const std::string &key, bool right, const uint32_t *&first, const uint32_t *&last)const
+{
+	const uint32_t *index = right ? by_right : by_left;
+	// <0, 0, >0 like memcmp for the column of entry id against key, broken entries sort last
+	auto compare = [&](uint32_t id)->int{
+		const char *begin;
+		size_t size;
+		if(id >= header->count || !column(entries[id], right, begin, size))
+			return 1;
+		const int cmp = memcmp(begin, key.data(), std::min(size, key.size()));
+		return cmp ? cmp : (size < key.size() ? -1 : size > key.size() ? 1 : 0);
+	};
+	first = std::partition_point(index, index + header->count, [&](uint32_t id){return compare(id) < 0;});
+	last = std::partition_point(first, index + header->count, [&](uint32_t id){return compare(id) == 0;});
+}
+
+bool MappingTable::lookup(const std::string &key, bool reverse, std::string &value)const
+{
+	if(!header)
+		return false;
+	const uint32_t *first, *last;
+	equalRange(key, reverse, first, last);
+	if(first == last)
+		return false;
+	// like the text format: the first line of a key wins, the last one if reversed
+	const Entry &entry = entries[reverse ? *(last - 1) : *first];
+	const char *begin;
+	size_t size;
+	if(!column(entry, !reverse, begin, size))
+		return false;
+	value.assign(begin, size);
+	return true;
+}
+
+bool MappingTable::contains(const std::string &value, bool reverse)const
+{
+	if(!header)
+		return false;
+	const uint32_t *first, *last;
+	equalRange(value, !reverse, first, last);
+	return first != last;
+}
+
+bool MappingTable::compile(std::istream &in, char terminator, const boost::filesystem::path &filename)
+{
+	std::vector<Entry> table;
+	std::string strings;
+	std::string buffer;
+	while(std::getline(in, buffer)){
+		if(buffer.empty())
+			continue;
+		const auto terminator_at = buffer.find(terminator);
+		if(terminator_at == 0 || terminator_at >= buffer.size()){
+			OrthancPlugins::LogError(std::string("No terminator found for patient mapping entry \"") + buffer + "\" ignoring it");
+			continue;
+		}
+		if(strings.size() + buffer.size() > UINT32_MAX){
+			OrthancPlugins::LogError("Patient mapping is too big to be compiled");
+			return false;
+		}
+		const uint32_t offset = strings.size();
+		table.push_back(Entry{offset, uint32_t(terminator_at), uint32_t(offset + terminator_at + 1), uint32_t(buffer.size() - terminator_at - 1)});
+		strings += buffer;
+	}
+
+	const auto sorted = [&](bool right){
+		std::vector<uint32_t> index(table.size());
+		for(uint32_t i = 0; i < index.size(); i++)
+			index[i] = i;
+		std::stable_sort(index.begin(), index.end(), [&](uint32_t a, uint32_t b){
+			const Entry &ea = table[a], &eb = table[b];
+			return strings.compare(right ? ea.right : ea.left, right ? ea.right_size : ea.left_size,
+				strings, right ? eb.right : eb.left, right ? eb.right_size : eb.left_size) < 0;
+		});
+		return index;
+	};
+	const std::vector<uint32_t> by_left = sorted(false), by_right = sorted(true);
+
+	Header header;
+	memcpy(header.magic, Magic, sizeof(Magic));
+	header.count = table.size();
+	header.strings = strings.size();
+
+	const boost::filesystem::path tmp = filename.native() + ".tmp";
+	std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	out.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(Entry));
+	out.write(reinterpret_cast<const char *>(by_left.data()), by_left.size() * sizeof(uint32_t));
+	out.write(reinterpret_cast<const char *>(by_right.data()), by_right.size() * sizeof(uint32_t));
+	out.write(strings.data(), strings.size());
+	out.close();
+	if(!out || rename(tmp.c_str(), filename.c_str()) != 0){
+		OrthancPlugins::LogError(std::string("Failed to write compiled mapping \"") + filename.native() + "\" (" + strerror(errno) + ")");
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#ifndef MAPPINGTABLE_HPP
+#define MAPPINGTABLE_HPP
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <istream>
+#include <string>
+
+/**
+ * Compiled, read-only form of a patient mapping file, used in place through mmap.
+ * Layout (native byte order):
+ * \code
+ * Header | Entry[count] (in the order of the text file) | uint32 by_left[count] | uint32 by_right[count] | strings
+ * \endcode
+ * by_left and by_right are the entries sorted (stable) by their left and right column, so lookups in either direction
+ * are a binary search and nothing has to be built when the file is loaded.
+ * A compiled file must be replaced (renamed over), never rewritten in place, while it is in use.
+ */
+class MappingTable
+{
+public:
+	struct Header{
+		char magic[8];
+		uint64_t count, strings;
+	};
+	struct Entry{
+		uint32_t left, left_size, right, right_size; // offsets into strings
+	};
+	static const char Magic[8];
+
+	MappingTable() = default;
+	MappingTable(const MappingTable &) = delete;
+	MappingTable &operator=(const MappingTable &) = delete;
+	~MappingTable();
+
+	/// true if filename starts like a compiled table
+	static bool isCompiled(const boost::filesystem::path &filename);
+	/// maps filename, returns false (and logs) if it's not a valid compiled table
+	bool open(const boost::filesystem::path &filename);
+
+	/// value the key maps to (the right column for the left one, or the other way round if reverse), false if there is none
+	bool lookup(const std::string &key, bool reverse, std::string &value)const;
+	/// true if value is a target of the mapping (in the right column, or the left one if reverse)
+	bool contains(const std::string &value, bool reverse)const;
+	size_t size()const{return header ? header->count : 0;}
+
+	/**
+	 * Reads lines "<left><terminator><right>" from in and writes the compiled table to filename.
+	 * The file is written under a temporary name and renamed into place, so it can replace a table in use.
+	 */
+	static bool compile(std::istream &in, char terminator, const boost::filesystem::path &filename);
+
+private:
+	void *mapped=nullptr;
+	size_t mapped_size=0;
+	const Header *header=nullptr;
+	const Entry *entries=nullptr;
+	const uint32_t *by_left=nullptr, *by_right=nullptr;
+	const char *strings=nullptr;
+
+	bool column(const Entry &entry, bool right, const char *&begin, size_t &size)const;
+	/// range [first,last) in index of the entries whose column equals key
+	void equalRange(const std::string &key, bool right, const uint32_t *&first, const uint32_t *&last)const;
+};
+
+#endif //MAPPINGTABLE_HPP
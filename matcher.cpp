@@ -0,0 +1,569 @@
+#include "matcher.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+const size_t MaxProgram = 4096; // bigger programs (from big counted repetitions) are left to std::regex
+const int Unbounded = -1;
+
+/// the pattern as plain string, false if it has anything but characters and escaped punctuation
+bool literalOf(const std::string &pattern, std::string &literal)
+{
+	literal.clear();
+	for(size_t i = 0; i < pattern.size(); i++){
+		const char c = pattern[i];
+		if(c == '\\'){
+			if(++i == pattern.size() || isalnum(static_cast<unsigned char>(pattern[i])))
+				return false;
+			literal += pattern[i];
+		} else if(strchr("^$.|?*+()[]{}", c))
+			return false;
+		else
+			literal += c;
+	}
+	return true;
+}
+bool isLineTerminator(char c){return c == '\n' || c == '\r';}
+
+/// what the threads of the VM need, kept per thread so matching doesn't allocate once it's warmed up
+struct ThreadList{
+	std::vector<int> pcs;
+	std::vector<const char *> slots; // captures of thread n at n*slot_count
+	size_t count = 0;
+};
+struct Scratch{
+	std::vector<unsigned> mark; // program counters already on the list being built have the current stamp
+	unsigned stamp = 0;
+	ThreadList lists[2];
+	std::vector<const char *> start;
+};
+thread_local Scratch scratch;
+}
+
+struct Matcher::Node{
+	enum Type{character, any, set, concat, alternate, repeat, group, begin, end} type;
+	int value = 0; // character, set index or group number
+	int min = 0, max = 0;
+	bool greedy = true;
+	std::vector<Node> kids;
+	explicit Node(Type type, int value = 0):type(type), value(value){}
+};
+
+/// recursive descent over the ECMAScript subset the VM handles, any failure means "leave it to std::regex"
+class Matcher::Parser{
+	const std::string &pattern;
+	size_t pos = 0;
+	Matcher &matcher;
+
+	bool more()const{return pos < pattern.size();}
+	char peek()const{return pattern[pos];}
+	int addSet(const std::bitset<256> &set){
+		matcher.sets.push_back(set);
+		return int(matcher.sets.size() - 1);
+	}
+	static bool classEscape(char c, std::bitset<256> &set){
+		set.reset();
+		for(int ch = 0; ch < 256; ch++){
+			const bool word = isalnum(ch) || ch == '_';
+			const bool space = strchr(" \t\n\v\f\r", ch) && ch;
+			switch(tolower(c)){
+				case 'd': set[ch] = isdigit(ch) != 0; break;
+				case 'w': set[ch] = word; break;
+				case 's': set[ch] = space; break;
+				default: return false;
+			}
+		}
+		if(isupper(static_cast<unsigned char>(c)))
+			set.flip();
+		return true;
+	}
+	/// the character of an escape (after the backslash), -1 if it isn't one
+	int characterEscape(){
+		const char c = pattern[pos++];
+		switch(c){
+			case 't': return '\t';
+			case 'n': return '\n';
+			case 'r': return '\r';
+			case 'f': return '\f';
+			case 'v': return '\v';
+			case '0': return more() && isdigit(static_cast<unsigned char>(peek())) ? -1 : 0;
+			case 'x':{
+				if(pattern.size() - pos < 2 || !isxdigit(static_cast<unsigned char>(pattern[pos])) || !isxdigit(static_cast<unsigned char>(pattern[pos + 1])))
+					return -1;
+				const int value = std::stoi(pattern.substr(pos, 2), nullptr, 16);
+				pos += 2;
+				return value;
+			}
+			default:
+				return isalnum(static_cast<unsigned char>(c)) ? -1 : static_cast<unsigned char>(c);
+		}
+	}
+	bool parseSet(Node &node){
+		std::bitset<256> set;
+		bool negated = false;
+		if(more() && peek() == '^'){
+			negated = true;
+			pos++;
+		}
+		if(more() && peek() == ']') // empty classes are left to std::regex
+			return false;
+		while(more() && peek() != ']'){
+			int from;
+			if(peek() == '\\'){
+				if(++pos == pattern.size())
+					return false;
+				std::bitset<256> escaped;
+				if(classEscape(peek(), escaped)){
+					pos++;
+					set |= escaped;
+					continue;
+				}
+				if(peek() == 'b' || (from = characterEscape()) < 0)
+					return false;
+			} else
+				from = static_cast<unsigned char>(pattern[pos++]);
+			int to = from;
+			if(pattern.size() - pos >= 2 && peek() == '-' && pattern[pos + 1] != ']'){
+				pos++;
+				if(peek() == '\\'){
+					if(++pos == pattern.size() || (to = characterEscape()) < 0)
+						return false;
+				} else
+					to = static_cast<unsigned char>(pattern[pos++]);
+				if(to < from)
+					return false;
+			}
+			for(int c = from; c <= to; c++)
+				set[c] = true;
+		}
+		if(!more())
+			return false;
+		pos++; // ]
+		if(negated)
+			set.flip();
+		node = Node(Node::set, addSet(set));
+		return true;
+	}
+	bool parseAtom(Node &node){
+		const char c = pattern[pos++];
+		switch(c){
+			case '.': node = Node(Node::any); return true;
+			case '^': node = Node(Node::begin); return true;
+			case '$': node = Node(Node::end); return true;
+			case '[': return parseSet(node);
+			case '(':{
+				int group = -1;
+				if(pattern.compare(pos, 2, "?:") == 0)
+					pos += 2;
+				else if(more() && peek() == '?') // look ahead and friends
+					return false;
+				else
+					group = int(matcher.group_count++);
+				Node inner(Node::concat);
+				if(!parseAlternative(inner) || !more() || peek() != ')')
+					return false;
+				pos++;
+				if(group < 0)
+					node = std::move(inner);
+				else {
+					node = Node(Node::group, group);
+					node.kids.push_back(std::move(inner));
+				}
+				return true;
+			}
+			case '\\':{
+				if(!more())
+					return false;
+				std::bitset<256> set;
+				if(classEscape(peek(), set)){
+					pos++;
+					node = Node(Node::set, addSet(set));
+					return true;
+				}
+				const int character = characterEscape();
+				if(character < 0) // back references, word boundaries, ...
+					return false;
+				node = Node(Node::character, character);
+				return true;
+			}
+			default:
+				if(strchr("*+?{}])|", c))
+					return false;
+				node = Node(Node::character, static_cast<unsigned char>(c));
+				return true;
+		}
+	}
+	bool parseNumber(int &number){
+		const size_t start = pos;
+		while(more() && isdigit(static_cast<unsigned char>(peek())))
+			pos++;
+		if(pos == start || pos - start > 4)
+			return false;
+		number = std::stoi(pattern.substr(start, pos - start));
+		return true;
+	}
+	bool parseQuantifier(Node &node){
+		int min, max;
+		switch(pattern[pos++]){
+			case '*': min = 0; max = Unbounded; break;
+			case '+': min = 1; max = Unbounded; break;
+			case '?': min = 0; max = 1; break;
+			case '{':
+				if(!parseNumber(min) || !more())
+					return false;
+				max = min;
+				if(peek() == ','){
+					pos++;
+					max = Unbounded;
+					if(more() && peek() != '}' && !parseNumber(max))
+						return false;
+				}
+				if(!more() || peek() != '}' || (max != Unbounded && max < min))
+					return false;
+				pos++;
+				break;
+			default: return false;
+		}
+		Node repeat(Node::repeat);
+		repeat.min = min;
+		repeat.max = max;
+		if(more() && peek() == '?'){
+			repeat.greedy = false;
+			pos++;
+		}
+		if(node.type == Node::begin || node.type == Node::end)
+			return false;
+		repeat.kids.push_back(std::move(node));
+		node = std::move(repeat);
+		return !more() || !strchr("*+?{", peek()); // a quantified quantifier is an error, std::regex will say so
+	}
+	bool parseSequence(Node &sequence){
+		sequence = Node(Node::concat);
+		while(more() && peek() != '|' && peek() != ')'){
+			Node atom(Node::concat);
+			if(!parseAtom(atom))
+				return false;
+			if(more() && strchr("*+?{", peek()) && !parseQuantifier(atom))
+				return false;
+			sequence.kids.push_back(std::move(atom));
+		}
+		return true;
+	}
+public:
+	Parser(const std::string &pattern, Matcher &matcher):pattern(pattern), matcher(matcher){}
+	bool parseAlternative(Node &node){
+		Node alternate(Node::alternate);
+		for(;;){
+			Node sequence(Node::concat);
+			if(!parseSequence(sequence))
+				return false;
+			alternate.kids.push_back(std::move(sequence));
+			if(!more() || peek() != '|')
+				break;
+			pos++;
+		}
+		if(alternate.kids.size() == 1)
+			node = std::move(alternate.kids.front());
+		else
+			node = std::move(alternate);
+		return true;
+	}
+	bool done()const{return !more();}
+};
+
+Matcher::Matcher(const std::string &pattern)
+{
+	if(!compile(pattern)){
+		type = Kind::fallback;
+		fallback = std::make_shared<const std::regex>(pattern, std::regex_constants::ECMAScript | std::regex_constants::optimize);
+		group_count = fallback->mark_count() + 1;
+		program.clear();
+		sets.clear();
+	}
+}
+
+bool Matcher::compile(const std::string &pattern)
+{
+	// ^ and $ don't change anything for a whole match, unless they are escaped
+	std::string body = pattern;
+	if(!body.empty() && body.front() == '^')
+		body.erase(0, 1);
+	if(!body.empty() && body.back() == '$'){
+		size_t escapes = 0;
+		while(escapes + 1 < body.size() && body[body.size() - 2 - escapes] == '\\')
+			escapes++;
+		if(escapes % 2 == 0)
+			body.pop_back();
+	}
+	if(literalOf(body, literal)){
+		type = Kind::literal;
+		return true;
+	}
+	if(body.size() >= 2 && body.compare(body.size() - 2, 2, ".*") == 0 && literalOf(body.substr(0, body.size() - 2), literal)){
+		type = Kind::prefix; // literalOf made sure the . isn't escaped, a trailing backslash would have failed it
+		return true;
+	}
+
+	Node root(Node::concat);
+	Parser parser(pattern, *this);
+	if(!parser.parseAlternative(root) || !parser.done())
+		return false;
+	program.push_back(Inst{Op::save, 0, 0});
+	emit(root);
+	program.push_back(Inst{Op::save, 1, 0});
+	program.push_back(Inst{Op::accept, 0, 0});
+	if(program.size() > MaxProgram)
+		return false;
+	type = Kind::vm;
+	// characters every match has to start with, checked before the VM is started
+	literal.clear();
+	for(size_t pc = 1; program[pc].op == Op::character; pc++)
+		literal += char(program[pc].x);
+	return true;
+}
+
+void Matcher::emit(const Node &node)
+{
+	if(program.size() > MaxProgram)
+		return;
+	switch(node.type){
+		case Node::character: program.push_back(Inst{Op::character, node.value, 0}); break;
+		case Node::any: program.push_back(Inst{Op::any, 0, 0}); break;
+		case Node::set: program.push_back(Inst{Op::set, node.value, 0}); break;
+		case Node::begin: program.push_back(Inst{Op::begin, 0, 0}); break;
+		case Node::end: program.push_back(Inst{Op::end, 0, 0}); break;
+		case Node::concat:
+			for(const Node &kid:node.kids)
+				emit(kid);
+			break;
+		case Node::group:
+			program.push_back(Inst{Op::save, 2 * node.value, 0});
+			emit(node.kids.front());
+			program.push_back(Inst{Op::save, 2 * node.value + 1, 0});
+			break;
+		case Node::alternate:{
+			// split L1, next; L1: kid; jump end; next: split L2, ... the last one goes without split
+			std::vector<size_t> jumps;
+			for(size_t k = 0; k < node.kids.size(); k++){
+				size_t split = 0;
+				if(k + 1 < node.kids.size()){
+					split = program.size();
+					program.push_back(Inst{Op::split, int(split + 1), 0});
+				}
+				emit(node.kids[k]);
+				if(k + 1 < node.kids.size()){
+					jumps.push_back(program.size());
+					program.push_back(Inst{Op::jump, 0, 0});
+					program[split].y = int(program.size());
+				}
+			}
+			for(size_t jump:jumps)
+				program[jump].x = int(program.size());
+			break;
+		}
+		case Node::repeat:{
+			const Node &kid = node.kids.front();
+			for(int i = 0; i < node.min; i++)
+				emit(kid);
+			if(node.max == Unbounded){
+				// loop: split body, out; body; jump loop
+				const size_t loop = program.size();
+				program.push_back(Inst{Op::split, 0, 0});
+				emit(kid);
+				program.push_back(Inst{Op::jump, int(loop), 0});
+				const int body = int(loop + 1), out = int(program.size());
+				program[loop].x = node.greedy ? body : out;
+				program[loop].y = node.greedy ? out : body;
+			} else {
+				// (kid(kid(...)?)?)? every split leaves to the very end
+				std::vector<size_t> splits;
+				for(int i = node.min; i < node.max && program.size() <= MaxProgram; i++){
+					splits.push_back(program.size());
+					program.push_back(Inst{Op::split, 0, 0});
+					emit(kid);
+				}
+				const int out = int(program.size());
+				for(size_t split:splits){
+					const int body = int(split + 1);
+					program[split].x = node.greedy ? body : out;
+					program[split].y = node.greedy ? out : body;
+				}
+			}
+			break;
+		}
+	}
+}
+
+const char *Matcher::kind()const
+{
+	switch(type){
+		case Kind::literal: return "literal";
+		case Kind::prefix: return "prefix";
+		case Kind::vm: return "vm";
+		default: return "std::regex";
+	}
+}
+
+bool Matcher::match(const char *begin, const char *end, Captures *captures)const
+{
+	bool matched;
+	switch(type){
+		case Kind::literal:
+			matched = size_t(end - begin) == literal.size() && std::equal(literal.begin(), literal.end(), begin);
+			break;
+		case Kind::prefix:
+			matched = size_t(end - begin) >= literal.size() && std::equal(literal.begin(), literal.end(), begin) &&
+				std::none_of(begin + literal.size(), end, isLineTerminator);
+			break;
+		case Kind::vm:
+			return size_t(end - begin) >= literal.size() && std::equal(literal.begin(), literal.end(), begin) && run(begin, end, captures);
+		default:{
+			std::cmatch found;
+			if(!std::regex_match(begin, end, found, *fallback))
+				return false;
+			if(captures){
+				captures->assign(2 * group_count, nullptr);
+				for(size_t g = 0; g < found.size() && g < group_count; g++)
+					if(found[g].matched){
+						(*captures)[2 * g] = found[g].first;
+						(*captures)[2 * g + 1] = found[g].second;
+					}
+			}
+			return true;
+		}
+	}
+	if(matched && captures)
+		captures->assign({begin, end});
+	return matched;
+}
+
+struct Matcher::Run{
+	const char *begin, *end;
+	size_t slot_count;
+	Scratch &scratch;
+};
+
+/// follows everything from pc that doesn't consume a character, the threads end up on list in order of their priority
+void Matcher::add(Run &run, int list, int pc, const char **caps, const char *at)const
+{
+	Scratch &s = run.scratch;
+	if(s.mark[pc] == s.stamp)
+		return;
+	s.mark[pc] = s.stamp;
+	const Inst &inst = program[pc];
+	switch(inst.op){
+		case Op::jump: add(run, list, inst.x, caps, at); break;
+		case Op::split:
+			add(run, list, inst.x, caps, at);
+			add(run, list, inst.y, caps, at);
+			break;
+		case Op::save:{
+			if(size_t(inst.x) >= run.slot_count){ // nobody wants the captures
+				add(run, list, pc + 1, caps, at);
+				break;
+			}
+			const char *old = caps[inst.x];
+			caps[inst.x] = at;
+			add(run, list, pc + 1, caps, at);
+			caps[inst.x] = old;
+			break;
+		}
+		case Op::begin: if(at == run.begin) add(run, list, pc + 1, caps, at); break;
+		case Op::end: if(at == run.end) add(run, list, pc + 1, caps, at); break;
+		default:{
+			ThreadList &threads = s.lists[list];
+			threads.pcs[threads.count] = pc;
+			std::copy(caps, caps + run.slot_count, threads.slots.begin() + threads.count * run.slot_count);
+			threads.count++;
+		}
+	}
+}
+
+bool Matcher::run(const char *begin, const char *end, Captures *captures)const
+{
+	Run run{begin, end, captures ? 2 * group_count : 0, scratch};
+	Scratch &s = run.scratch;
+	if(s.mark.size() < program.size())
+		s.mark.resize(program.size(), 0);
+	for(ThreadList &list:s.lists){
+		if(list.pcs.size() < program.size())
+			list.pcs.resize(program.size());
+		if(list.slots.size() < program.size() * run.slot_count)
+			list.slots.resize(program.size() * run.slot_count);
+		list.count = 0;
+	}
+	s.start.assign(run.slot_count, nullptr);
+
+	const auto newList = [&s](){
+		if(++s.stamp == 0){
+			std::fill(s.mark.begin(), s.mark.end(), 0);
+			s.stamp = 1;
+		}
+	};
+	int current = 0;
+	newList();
+	add(run, current, 0, s.start.data(), begin);
+	for(const char *at = begin; s.lists[current].count; at++){
+		const int next = 1 - current;
+		s.lists[next].count = 0;
+		newList();
+		for(size_t t = 0; t < s.lists[current].count; t++){
+			const int pc = s.lists[current].pcs[t];
+			const Inst &inst = program[pc];
+			const char **caps = s.lists[current].slots.data() + t * run.slot_count;
+			bool step = false;
+			switch(inst.op){
+				case Op::accept:
+					if(at == end){ // the first one to get to the end has priority
+						if(captures)
+							captures->assign(caps, caps + run.slot_count);
+						return true;
+					}
+					break;
+				case Op::character: step = at < end && static_cast<unsigned char>(*at) == inst.x; break;
+				case Op::any: step = at < end && !isLineTerminator(*at); break;
+				case Op::set: step = at < end && sets[inst.x][static_cast<unsigned char>(*at)]; break;
+				default: break;
+			}
+			if(step)
+				add(run, next, pc + 1, caps, at + 1);
+		}
+		if(at == end)
+			break;
+		current = next;
+	}
+	return false;
+}
+
+std::string Matcher::format(const std::string &fmt, const Captures &captures)
+{
+	std::string out;
+	const auto group = [&](size_t g){
+		if(2 * g + 1 < captures.size() && captures[2 * g])
+			out.append(captures[2 * g], captures[2 * g + 1]);
+	};
+	for(size_t i = 0; i < fmt.size(); i++){
+		if(fmt[i] != '$' || i + 1 == fmt.size()){
+			out += fmt[i];
+			continue;
+		}
+		const char c = fmt[++i];
+		if(c == '$')
+			out += '$';
+		else if(c == '&')
+			group(0);
+		else if(c == '`' || c == '\'')
+			; // prefix and suffix, always empty for a whole match
+		else if(isdigit(static_cast<unsigned char>(c))){
+			size_t g = c - '0';
+			if(i + 1 < fmt.size() && isdigit(static_cast<unsigned char>(fmt[i + 1])))
+				g = g * 10 + (fmt[++i] - '0');
+			group(g);
+		} else {
+			out += '$';
+			out += c;
+		}
+	}
+	return out;
+}
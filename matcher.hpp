@@ -0,0 +1,64 @@
+#ifndef MATCHER_HPP
+#define MATCHER_HPP
+
+#include <bitset>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * Drop-in for std::regex_match (ECMAScript syntax) on configured patterns, without backtracking.
+ * Patterns that are a plain string, optionally anchored with ^ and $, or a string followed by .* are compared directly.
+ * Everything else is compiled into a program for a Pike VM (Thompson NFA simulation keeping the captures), which runs
+ * in time linear in the input. It matches the same strings as std::regex and, with one exception, gives the same
+ * captures (leftmost, greedy/lazy as written): in a loop over a group that can match empty, std::regex takes one more,
+ * empty, iteration and the VM doesn't, so (a*)+ on "a" gives $1 = "" there and "a" here (see test/matcher_test.cpp).
+ * Syntax the VM doesn't do (back references, look ahead, word boundaries, ...) is left to std::regex.
+ * A Matcher is immutable after construction and can be used by many threads at once.
+ */
+class Matcher
+{
+public:
+	/// begin/end of group n at 2n and 2n+1, both nullptr if the group didn't take part in the match
+	typedef std::vector<const char *> Captures;
+
+	/// throws std::regex_error (like std::regex) if pattern is not valid
+	explicit Matcher(const std::string &pattern);
+
+	/// true if the whole of [begin,end) matches, captures (if given) are set accordingly
+	bool match(const char *begin, const char *end, Captures *captures = nullptr)const;
+	bool match(const std::string &text, Captures *captures = nullptr)const{return match(text.data(), text.data() + text.size(), captures);}
+	/// number of groups including the whole match
+	size_t groups()const{return group_count;}
+	/// what is used for the pattern, "literal", "prefix", "vm" or "std::regex"
+	const char *kind()const;
+
+	/// replaces $&, $n, $nn and $$ in fmt like std::match_results::format does
+	static std::string format(const std::string &fmt, const Captures &captures);
+
+private:
+	enum class Kind{literal, prefix, vm, fallback};
+	enum class Op:uint8_t{character, any, set, split, jump, save, begin, end, accept};
+	struct Inst{
+		Op op;
+		int x, y; // character, set index, slot or jump targets (split prefers x)
+	};
+	struct Node;
+	class Parser;
+	struct Run;
+
+	Kind type;
+	std::string literal; // the string for literal and prefix, what a match has to start with for vm
+	std::vector<Inst> program;
+	std::vector<std::bitset<256>> sets;
+	size_t group_count = 1;
+	std::shared_ptr<const std::regex> fallback;
+
+	bool compile(const std::string &pattern);
+	void emit(const Node &node);
+	bool run(const char *begin, const char *end, Captures *captures)const;
+	void add(Run &run, int list, int pc, const char **caps, const char *at)const;
+};
+
+#endif //MATCHER_HPP
@@ -0,0 +1,47 @@
+#include "patientfields.hpp"
+#include "dicomscanner.hpp"
+#include <algorithm>
+#include <memory>
+#include <jsoncpp/json/reader.h>
+
+namespace {
+/// the first of the values in text without padding, like the DicomScanner gives it
+std::string firstValue(const std::string &text)
+{
+	const char *begin = text.data(), *end = std::find(begin, begin + text.size(), '\\');
+	while(begin < end && *begin == ' ')begin++;
+	while(end > begin && (end[-1] == ' ' || end[-1] == '\0'))end--;
+	return std::string(begin, end);
+}
+}
+
+bool PatientFields::fromFile(const void *data, size_t size)
+{
+	typedef DicomScanner S;
+	// the scanner keeps its buffers between instances
+	static thread_local S scanner({S::makeTag(0x0010, 0x0010), S::makeTag(0x0010, 0x0020)});
+	if(!data || !scanner.scan(data, size))
+		return false;
+	const char *begin, *end;
+	if((has_id = scanner.get(S::makeTag(0x0010, 0x0020), begin, end)))
+		id.assign(begin, end);
+	if((has_name = scanner.get(S::makeTag(0x0010, 0x0010), begin, end)))
+		name.assign(begin, end);
+	return true;
+}
+
+bool PatientFields::fromJson(const char *begin, const char *end)
+{
+	// the parser keeps its state in the reader, so every thread needs its own
+	static thread_local const std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+	Json::Value root;
+	std::string errs;
+	if(!reader->parse(begin, end, &root, &errs))
+		return false;
+	// multiple values come as one string separated by backslashes
+	if((has_id = root.isMember("PatientID")))
+		id = firstValue(root["PatientID"].asString());
+	if((has_name = root.isMember("PatientName")))
+		name = firstValue(root["PatientName"].asString());
+	return true;
+}
@@ -0,0 +1,22 @@
+#ifndef PATIENTFIELDS_HPP
+#define PATIENTFIELDS_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * PatientID and PatientName of a received instance as the instance filter checks them: the first value with leading
+ * and trailing spaces (and trailing NULs) removed, whether they come from the encoded file or from Orthanc's JSON.
+ */
+struct PatientFields
+{
+	bool has_id = false, has_name = false;
+	std::string id, name;
+
+	/// reads them straight from the encoded file, false if the DicomScanner can't handle it
+	bool fromFile(const void *data, size_t size);
+	/// from the simplified JSON of the instance, for files fromFile can't read; false if it is not valid JSON
+	bool fromJson(const char *begin, const char *end);
+};
+
+#endif //PATIENTFIELDS_HPP
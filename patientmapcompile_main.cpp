@@ -0,0 +1,29 @@
+#include "mappingtable.hpp"
+#include <fstream>
+#include <iostream>
+
+// the shared code logs through the plugin wrapper, without Orthanc that goes to stderr
+namespace OrthancPlugins{
+void LogError(const std::string &message){std::cerr << "E: " << message << std::endl;}
+void LogWarning(const std::string &message){std::cerr << "W: " << message << std::endl;}
+void LogInfo(const std::string &){}
+}
+
+/*
+ * Compiles a patient mapping text file (as used for "PatientIDMap") into the binary form the instance filter can map
+ * directly. Point "File" to the output, "Reverse" and "RelevantChars" still apply.
+ */
+int main(int argc, char **argv)
+{
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " <mapping text file> <compiled file> [terminator]" << std::endl;
+		return 1;
+	}
+	std::ifstream in(argv[1]);
+	if(!in){
+		std::cerr << "Failed to open " << argv[1] << std::endl;
+		return 1;
+	}
+	const char terminator = argc > 3 ? argv[3][0] : '|';
+	return MappingTable::compile(in, terminator, argv[2]) ? 0 : 2;
+}
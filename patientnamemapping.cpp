@@ -3,33 +3,46 @@
 //
 
 #include "patientnamemapping.hpp"
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
 
-std::string PatientNameMapping::lookup(std::string org)
+std::string PatientNameMapping::lookup(const Snapshot &snap, std::string org)const
 {
 	if(relevant_chars && org.size()>relevant_chars) {
-		auto inner = lookup(org.substr(0, relevant_chars));
+		auto inner = lookup(snap, org.substr(0, relevant_chars));
 		if(inner.empty())
 			return {};
 		else
 			return org.replace(0, relevant_chars, inner);
+	} else if(snap.compiled) {
+		std::string found;
+		snap.table.lookup(org, reverse, found);
+		return found;
 	} else {
-		if (std::chrono::system_clock::now() - last_update > std::chrono::minutes(10)) {
-			try { update(); }
-			catch (const std::ios_base::failure &fail) {
-				OrthancPlugins::LogError(std::string("Failed to update patient mapping from ") + filename.native() + "(" + fail.what() + ")");
-			}
-		}
-		auto found = map.find(org);
-		if (found != map.end())
+		auto found = snap.map.find(org);
+		if (found != snap.map.end())
 			return found->second;
 		else
 			return {};
 	}
 }
 
-bool PatientNameMapping::knownValue(std::string value)
+std::string PatientNameMapping::lookup(std::string org)const
+{
+	const Published<Snapshot>::Reader snap(current);
+	return lookup(*snap, std::move(org));
+}
+
+bool PatientNameMapping::knownValue(const std::string &value)const
 {
-	return values.find(value)!=values.end();
+	const Published<Snapshot>::Reader snap(current);
+	if(snap->compiled)
+		return snap->table.contains(value, reverse);
+	return snap->values.find(value)!=snap->values.end();
 }
 
 PatientNameMapping::PatientNameMapping(const OrthancPlugins::OrthancConfiguration &map)
@@ -38,19 +51,58 @@ PatientNameMapping::PatientNameMapping(const OrthancPlugins::OrthancConfiguratio
 	terminator=map.GetStringValue("Terminator","|")[0];
 	relevant_chars = map.GetIntegerValue("RelevantChars",4);
 	reverse=map.GetBooleanValue("Reverse",false);
+	current.publish(std::unique_ptr<const Snapshot>(new Snapshot));
+
+	// the directory is watched, as editors and scripts usually replace the file instead of writing into it
+	// that starts before the first load, so changes made meanwhile aren't missed
+	notify=inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+	if(notify < 0 || inotify_add_watch(notify, filename.parent_path().empty() ? "." : filename.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		OrthancPlugins::LogWarning(std::string("Can't watch patient name map file \"") + filename.native() + "\" for changes, reloading every 10 minutes only");
 
 	if(exists(filename))
 		update();
 	else
 		OrthancPlugins::LogError(std::string("Patient name map file \"") + filename.native() + "\" does not exist");
+
+	if(pipe2(stop_pipe, O_CLOEXEC) == 0)
+		watcher=std::thread(&PatientNameMapping::watch,this);
+	else
+		OrthancPlugins::LogError(std::string("Failed to start watching patient name map file \"") + filename.native() + "\" (" + strerror(errno) + ")");
+}
+
+PatientNameMapping::~PatientNameMapping()
+{
+	if(watcher.joinable()){
+		const char stop=0;
+		if(write(stop_pipe[1], &stop, 1) == 1)
+			watcher.join();
+		else
+			watcher.detach();
+	}
+	for(int fd:{stop_pipe[0], stop_pipe[1], notify})
+		if(fd >= 0)
+			close(fd);
 }
 
 void PatientNameMapping::update()
 {
+	if(MappingTable::isCompiled(filename)){ // just map it
+		std::unique_ptr<Snapshot> next(new Snapshot);
+		OrthancPlugins::LogError(std::string("(Re)mapping compiled patient name mapping from ") + filename.native());
+		if(!next->table.open(filename))
+			return; // keep what we have
+		next->compiled=true;
+		current.publish(std::move(next));
+		generation++;
+		return;
+	}
 	std::ifstream in(filename.c_str());
+	if(!in.is_open()){ // keep what we have
+		OrthancPlugins::LogError(std::string("Failed to open patient name map file \"") + filename.native() + "\" (" + strerror(errno) + ")");
+		return;
+	}
 	in.exceptions(std::ifstream::badbit);
-	map.clear();
-	values.clear();
+	std::unique_ptr<Snapshot> next(new Snapshot);
 	OrthancPlugins::LogError(std::string("(Re)loading patient name mapping from ") + filename.native());
 	while(in.good()){
 		std::string buffer;
@@ -64,12 +116,43 @@ void PatientNameMapping::update()
 		}
 		auto mapping=std::make_pair(buffer.substr(0,terminator_at),buffer.substr(terminator_at+1));
 		if(reverse) {
-			map[mapping.second] = mapping.first;
-			values.insert(mapping.first);
+			next->map[mapping.second] = mapping.first;
+			next->values.insert(mapping.first);
 		} else {
-			map.insert(mapping);
-			values.insert(mapping.second);
+			next->map.insert(mapping);
+			next->values.insert(mapping.second);
+		}
+	}
+	current.publish(std::move(next));
+	generation++;
+}
+
+void PatientNameMapping::watch()
+{
+	for(;;){
+		pollfd fds[2]={{stop_pipe[0], POLLIN, 0}, {notify, POLLIN, 0}};
+		const int ready=poll(fds, notify < 0 ? 1 : 2, 10*60*1000);
+		if(ready < 0 && errno != EINTR)
+			break;
+		if(fds[0].revents)
+			break;
+
+		bool changed = ready == 0; // timed out
+		if(ready > 0 && fds[1].revents){
+			alignas(inotify_event) char events[4096];
+			ssize_t red;
+			while((red=read(notify, events, sizeof(events))) > 0)
+				for(char *p=events; p < events + red; p+=sizeof(inotify_event) + reinterpret_cast<inotify_event *>(p)->len){
+					const inotify_event *event=reinterpret_cast<inotify_event *>(p);
+					if(event->len && filename.filename() == event->name)
+						changed=true;
+				}
+		}
+		if(!changed || !exists(filename))
+			continue;
+		try { update(); }
+		catch (const std::ios_base::failure &fail) {
+			OrthancPlugins::LogError(std::string("Failed to update patient mapping from ") + filename.native() + "(" + fail.what() + ")");
 		}
 	}
-	last_update=std::chrono::system_clock::now();
 }
@@ -7,25 +7,49 @@
 
 #include "OrthancPluginCppWrapper.h"
 #include <boost/filesystem.hpp>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "mappingtable.hpp"
+#include "published.hpp"
 
 using boost::filesystem::path;
 
+/**
+ * Maps patient names/IDs as listed in a text file.
+ * The content of the file is held in an immutable snapshot, readers just announce which one they use (see Published). A
+ * background thread builds a new snapshot (or maps the file if it's compiled, see MappingTable) whenever the file was written or replaced (watched with inotify) and every
+ * 10 minutes, and then swaps it in. So neither lookups nor stores ever wait for a reload.
+ */
 class PatientNameMapping {
+	struct Snapshot{
+		std::map<std::string, std::string> map;
+		std::set<std::string> values;
+		MappingTable table; // used instead of map and values if compiled
+		bool compiled=false;
+	};
 	path filename;
 	size_t relevant_chars=0;
 	char terminator=0;
 	bool reverse=false;
-	std::chrono::time_point<std::chrono::system_clock> last_update;
-	std::map<std::string, std::string> map;
-	std::set<std::string> values;
+	Published<Snapshot> current;
+	int stop_pipe[2]={-1,-1}, notify=-1;
+	std::thread watcher;
 
+	std::string lookup(const Snapshot &snap, std::string org)const;
 	void update();
+	void watch();
 
 public:
+	std::atomic<uint64_t> generation{0}; // counts the reloads, anything derived from the mapping is outdated when it changes
+
 	PatientNameMapping(const OrthancPlugins::OrthancConfiguration &map);
+	PatientNameMapping(const PatientNameMapping &) = delete;
+	PatientNameMapping &operator=(const PatientNameMapping &) = delete;
+	~PatientNameMapping();
 
-	std::string lookup(std::string org);
-	bool knownValue(std::string value);
+	std::string lookup(std::string org)const;
+	bool knownValue(const std::string &value)const;
 };
 
 /**
@@ -38,7 +62,7 @@ public:
  *   "Reverse" : true
  * },
  * \endcode
- * "file" is expected with lines "<oldname><terminator><newname>"
+ * "file" is expected with lines "<oldname><terminator><newname>", or compiled by patientmapcompile
  * the mapping will be reversed if "Reverse" is true
  */
 void RegisterPatientNameMapping(const OrthancPlugins::OrthancConfiguration &map);
@@ -0,0 +1,42 @@
+#include "prefetcher.hpp"
+#include "shadowtree.hpp"
+#include "fileio.hpp"
+#include <fcntl.h>
+#include <algorithm>
+
+namespace fs = boost::filesystem;
+
+namespace {
+const size_t RecentSeries = 64;
+}
+
+SeriesPrefetcher::SeriesPrefetcher(size_t max_files, size_t queue):worker(1, queue), max_files(max_files){}
+
+void SeriesPrefetcher::read(const fs::path &org)
+{
+	if(!worker.trySubmit([this, org]{prefetch(org);}))
+		dropped++;
+}
+
+void SeriesPrefetcher::prefetch(const fs::path &org)
+{
+	const fs::path shadow = shadow_index.lookup(org);
+	if(shadow.empty())
+		return;
+	const fs::path dir = shadow.parent_path();
+	if(std::find(recent.begin(), recent.end(), dir.native()) != recent.end())
+		return;
+	recent.push_back(dir.native());
+	if(recent.size() > RecentSeries)
+		recent.pop_front();
+
+	series++;
+	size_t done = 0;
+	boost::system::error_code ec;
+	for(fs::directory_iterator it(dir, ec), end; !ec && it != end && done < max_files; it.increment(ec)){
+		FileDescriptor file(it->path().c_str(), O_RDONLY);
+		if(file.good() && posix_fadvise(file, 0, 0, POSIX_FADV_WILLNEED) == 0)
+			done++;
+	}
+	files += done;
+}
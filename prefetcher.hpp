@@ -0,0 +1,31 @@
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <deque>
+#include <string>
+#include "workerpool.hpp"
+
+/**
+ * Read-ahead for the rest of a series.
+ * When an instance is read, its series directory in the shadow tree (found via the ShadowIndex) is listed by a
+ * background thread and the kernel is asked to read up to max_files of its siblings (posix_fadvise WILLNEED).
+ * The shadows are hardlinks, so that fills the page cache for the originals as well.
+ * Requests coming in while the thread is busy are dropped, and series done lately are not done again.
+ */
+class SeriesPrefetcher
+{
+	WorkerPool worker;
+	const size_t max_files;
+	std::deque<std::string> recent; // only touched by the worker thread
+	void prefetch(const boost::filesystem::path &org);
+public:
+	std::atomic<uint64_t> series{0}, files{0}, dropped{0};
+
+	SeriesPrefetcher(size_t max_files, size_t queue);
+	/// to be called whenever org was read
+	void read(const boost::filesystem::path &org);
+};
+
+#endif //PREFETCHER_HPP
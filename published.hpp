@@ -0,0 +1,140 @@
+#ifndef PUBLISHED_HPP
+#define PUBLISHED_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Holds the current version of an immutable T, which is replaced now and then while any number of threads read it.
+ * Readers neither lock nor allocate: each thread announces the version it reads in its own slot (a hazard pointer),
+ * and a replaced version is only deleted once no slot holds it anymore. Versions still in use when they are replaced
+ * are deleted by a later publish() (or the destructor).
+ * Only threads beyond the first MaxReaders reading at the same time have to fall back to a mutex.
+ * A thread must not hold two Readers of the same Published at once.
+ */
+template<class T> class Published
+{
+public:
+	static const size_t MaxReaders = 256;
+
+	/// the version that was current when it was made, stays valid as long as the Reader exists
+	class Reader
+	{
+		const Published &published;
+		const size_t slot;
+		const T *value;
+	public:
+		explicit Reader(const Published &published);
+		Reader(const Reader &) = delete;
+		Reader &operator=(const Reader &) = delete;
+		~Reader();
+		const T &operator*()const{return *value;}
+		const T *operator->()const{return value;}
+	};
+
+	Published(){for(auto &hazard:hazards)hazard.store(nullptr);}
+	Published(const Published &) = delete;
+	Published &operator=(const Published &) = delete;
+	/// there must be no Readers left
+	~Published();
+	/// makes next the current version
+	void publish(std::unique_ptr<const T> next);
+
+private:
+	std::atomic<const T *> current{nullptr};
+	mutable std::atomic<const T *> hazards[MaxReaders]; // what the thread of each slot is reading
+	mutable std::mutex overflow; // held by readers that didn't get a slot
+	std::mutex publishing;
+	std::vector<const T *> retired; // replaced, but maybe still read
+
+	/// slot of the calling thread (the same for all instances), MaxReaders if all are taken
+	static size_t slot();
+	void reclaim();
+};
+
+template<class T> size_t Published<T>::slot()
+{
+	static std::atomic<bool> taken[MaxReaders]; // static, so all false to begin with
+	struct Claim{
+		size_t index = MaxReaders;
+		Claim(){
+			for(size_t i = 0; i < MaxReaders && index == MaxReaders; i++){
+				bool expected = false;
+				if(taken[i].compare_exchange_strong(expected, true))
+					index = i;
+			}
+		}
+		~Claim(){ // the thread ends, its slot can be used by another one
+			if(index < MaxReaders)
+				taken[index] = false;
+		}
+	};
+	thread_local Claim claim;
+	return claim.index;
+}
+
+template<class T> Published<T>::Reader::Reader(const Published &published):published(published), slot(Published::slot())
+{
+	if(slot == MaxReaders){
+		published.overflow.lock();
+		value = published.current.load();
+		return;
+	}
+	// once the slot holds what still is current, it can't be deleted before the slot is cleared
+	const T *p = published.current.load();
+	for(;;){
+		published.hazards[slot].store(p);
+		const T *now = published.current.load();
+		if(now == p)
+			break;
+		p = now;
+	}
+	value = p;
+}
+
+template<class T> Published<T>::Reader::~Reader()
+{
+	if(slot == MaxReaders)
+		published.overflow.unlock();
+	else
+		published.hazards[slot].store(nullptr);
+}
+
+template<class T> Published<T>::~Published()
+{
+	delete current.load();
+	for(const T *old:retired)
+		delete old;
+}
+
+template<class T> void Published<T>::publish(std::unique_ptr<const T> next)
+{
+	std::lock_guard<std::mutex> lock(publishing);
+	const T *old = current.exchange(next.release());
+	if(old)
+		retired.push_back(old);
+	reclaim();
+}
+
+template<class T> void Published<T>::reclaim()
+{
+	std::lock_guard<std::mutex> lock(overflow); // so readers without a slot are done with what they read
+	auto keep = retired.begin();
+	for(const T *old:retired){
+		bool used = false;
+		for(const auto &hazard:hazards)
+			if(hazard.load() == old){
+				used = true;
+				break;
+			}
+		if(used)
+			*keep++ = old;
+		else
+			delete old;
+	}
+	retired.erase(keep, retired.end());
+}
+
+#endif //PUBLISHED_HPP
@@ -0,0 +1,53 @@
+#include "readcache.hpp"
+
+ReadCache::ReadCache(size_t budget, size_t max_entry):budget(budget), max_entry(max_entry){}
+
+ReadCache::Data ReadCache::get(const std::string &uuid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = index.find(uuid);
+	if(found == index.end()){
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	entries.splice(entries.begin(), entries, found->second);
+	return found->second->second;
+}
+
+void ReadCache::put(const std::string &uuid, Data data)
+{
+	if(!admits(data->size())){
+		rejected++;
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if(index.count(uuid))
+		return;
+	used += data->size();
+	entries.emplace_front(uuid, std::move(data));
+	index[uuid] = entries.begin();
+	while(used > budget){
+		used -= entries.back().second->size();
+		index.erase(entries.back().first);
+		entries.pop_back();
+		evictions++;
+	}
+}
+
+void ReadCache::erase(const std::string &uuid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = index.find(uuid);
+	if(found == index.end())
+		return;
+	used -= found->second->second->size();
+	entries.erase(found->second);
+	index.erase(found);
+}
+
+size_t ReadCache::size()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return used;
+}
@@ -0,0 +1,40 @@
+#ifndef READCACHE_HPP
+#define READCACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Thread safe LRU cache of whole files keyed by uuid, limited to a byte budget.
+ * Files bigger than max_entry are never admitted, so a single huge multi-frame instance can't flush the cache.
+ */
+class ReadCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<char>> Data;
+private:
+	typedef std::list<std::pair<std::string, Data>> Entries;
+	std::mutex mutex;
+	Entries entries; // most recently used first
+	std::unordered_map<std::string, Entries::iterator> index;
+	const size_t budget, max_entry;
+	size_t used=0;
+public:
+	std::atomic<uint64_t> hits{0}, misses{0}, evictions{0}, rejected{0};
+
+	ReadCache(size_t budget, size_t max_entry);
+	/// returns nullptr if uuid is not cached
+	Data get(const std::string &uuid);
+	/// true if data of that size would be admitted
+	bool admits(size_t size)const{return size <= max_entry && size <= budget;}
+	void put(const std::string &uuid, Data data);
+	void erase(const std::string &uuid);
+	size_t size();
+};
+
+#endif //READCACHE_HPP
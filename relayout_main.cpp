@@ -0,0 +1,78 @@
+#include "shadowtree.hpp"
+#include "filemove.hpp"
+#include "workerpool.hpp"
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+// the shared code logs through the plugin wrapper, without Orthanc that goes to stderr
+namespace OrthancPlugins{
+void LogError(const std::string &message){std::cerr << "E: " << message << std::endl;}
+void LogWarning(const std::string &message){std::cerr << "W: " << message << std::endl;}
+void LogInfo(const std::string &){}
+}
+
+namespace {
+std::atomic<bool> cancelled{false}; // lock free, so the signal handler may set it
+void cancel(int){cancelled = true;}
+}
+
+/*
+ * Moves the files of a storage directory from one layout to another while Orthanc keeps running.
+ * Set "StoragePreviousLayout" to the old and "StorageLayout" to the new layout first, so the plugin writes new files
+ * into the new layout and still finds the ones this didn't get to yet. Can be interrupted and restarted at any time.
+ */
+int main(int argc, char **argv)
+{
+	if(argc < 4){
+		std::cerr << "Usage: " << argv[0] << " <StorageDirectory> <from layout> <to layout> [threads]" << std::endl
+			<< "  layouts are given like \"2x2\" or \"3x2:disk0,disk1\"" << std::endl;
+		return 1;
+	}
+	oroot = argv[1];
+	previous_layout.reset(new StorageLayout);
+	if(!StorageLayout::parse(argv[2], *previous_layout) || !StorageLayout::parse(argv[3], layout)){
+		std::cerr << "Invalid layout" << std::endl;
+		return 1;
+	}
+	const unsigned threads = argc > 4 ? std::stoul(argv[4]) : std::thread::hardware_concurrency();
+	known_dirs.reset(new DirectoryCache(10000));
+
+	WorkerPool workers(threads, threads * 2);
+	// Ctrl-C (or a TERM) lets the files being moved finish, what's left is done by the next run
+	std::signal(SIGINT, cancel);
+	std::signal(SIGTERM, cancel);
+	std::atomic<uint64_t> files{0}, moved{0}, copied{0}, errors{0};
+	const std::vector<boost::filesystem::path> tops = topDirectories({oroot});
+	for(size_t t = 0; t < tops.size() && !cancelled; t++){
+		const std::vector<boost::filesystem::path> leaves = leafDirectories(tops[t]);
+		workers.forEach(leaves.size(), [&](size_t i){
+			boost::system::error_code ec;
+			for(boost::filesystem::directory_iterator it(leaves[i], ec), end; !ec && it != end && !cancelled; it.increment(ec)){
+				if(!isAttachment(*it))
+					continue;
+				files++;
+				const std::string uuid = it->path().filename().native();
+				const boost::filesystem::path dst = GetOPath(uuid);
+				if(dst == it->path())
+					continue;
+				const int64_t bytes = moveOriginal(it->path(), dst);
+				if(bytes < 0)
+					errors++;
+				else {
+					moved++;
+					copied += bytes;
+				}
+			}
+		}, cancelled);
+		std::cerr << "\r" << (t + 1) * 100 / tops.size() << "% " << files << " files, " << moved << " moved" << std::flush;
+	}
+
+	std::cout << std::endl
+		<< (cancelled ? "interrupted, run again to move the rest\n" : "")
+		<< "files:  " << files << std::endl
+		<< "moved:  " << moved << std::endl
+		<< "copied: " << copied << " bytes" << std::endl
+		<< "errors: " << errors << std::endl;
+	return errors ? 2 : cancelled ? 3 : 0;
+}
@@ -0,0 +1,180 @@
+#include "reprocess.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+thread_local bool Reprocess::storing=false;
+
+namespace {
+/// adds the time since it was made to total when it goes out of scope
+class StageTimer{
+	std::atomic<uint64_t> &total;
+	const std::chrono::steady_clock::time_point start=std::chrono::steady_clock::now();
+public:
+	explicit StageTimer(std::atomic<uint64_t> &total):total(total){}
+	~StageTimer(){
+		total+=std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-start).count();
+	}
+};
+/// IDs of the instances in answer of /patients/../instances or /studies/../instances
+void appendIDs(const Json::Value &answer, std::vector<std::string> &ids){
+	for(const Json::Value &instance:answer)
+		if(instance.isMember("ID"))
+			ids.push_back(instance["ID"].asString());
+}
+}
+
+Reprocess::Reprocess(std::vector<std::string> patients, std::vector<std::string> studies, unsigned threads, unsigned max_io, Processor processor, bool header_only):
+	workers(threads, threads * 2), processor(std::move(processor)), header_only(header_only),
+	patients(std::move(patients)), studies(std::move(studies)), max_io(max_io ? max_io : 1){}
+
+void Reprocess::list()
+{
+	for(const std::string &patient:patients){
+		Json::Value answer;
+		if(OrthancPlugins::RestApiGet(answer, "/patients/" + patient + "/instances", false))
+			appendIDs(answer, instances);
+		else {
+			OrthancPlugins::LogError("Failed to list the instances of patient " + patient);
+			errors++;
+		}
+	}
+	for(const std::string &study:studies){
+		Json::Value answer;
+		if(OrthancPlugins::RestApiGet(answer, "/studies/" + study + "/instances", false))
+			appendIDs(answer, instances);
+		else {
+			OrthancPlugins::LogError("Failed to list the instances of study " + study);
+			errors++;
+		}
+	}
+	std::sort(instances.begin(), instances.end()); // a study can be given on its own and with its patient
+	instances.erase(std::unique(instances.begin(), instances.end()), instances.end());
+	done.assign(instances.size(), false);
+	listed=true;
+}
+
+bool Reprocess::store(const std::string &id, const void *data, size_t size, std::string &new_id)
+{
+	Json::Value answer;
+	storing=true;
+	const bool stored=OrthancPlugins::RestApiPost(answer, "/instances", data, size, false);
+	storing=false;
+	if(!stored || !answer.isMember("ID"))
+		return false;
+	new_id=answer["ID"].asString();
+	return new_id != id || answer["Status"].asString() != "AlreadyStored";
+}
+
+void Reprocess::process(const std::string &id)
+{
+	// fetching and storing hit the storage, only max_io threads may do that at once
+	const auto io=[this](const std::function<bool()> &fn){
+		std::unique_lock<std::mutex> lock(io_mutex);
+		io_free.wait(lock, [this]{return io_running < max_io;});
+		io_running++;
+		lock.unlock();
+		const bool ret=fn();
+		lock.lock();
+		io_running--;
+		io_free.notify_one();
+		return ret;
+	};
+	files++;
+
+	OrthancPlugins::MemoryBuffer original;
+	bool fetched;
+	{
+		StageTimer timer(fetch_us);
+		fetched=io([&]{return original.RestApiGet("/instances/" + id + "/file", false);});
+	}
+	if(!fetched){
+		OrthancPlugins::LogError("Failed to fetch instance " + id);
+		errors++;
+		return;
+	}
+
+	std::unique_ptr<DicomHandle> dcmfile;
+	{
+		StageTimer timer(parse_us);
+		dcmfile.reset(new DicomHandle(original.GetData(), original.GetSize(), header_only));
+	}
+	if(!dcmfile->valid){
+		OrthancPlugins::LogError("Failed to parse instance " + id);
+		errors++;
+		return;
+	}
+
+	bool modified=false, good;
+	{
+		StageTimer timer(process_us);
+		good=processor(*dcmfile, modified);
+	}
+	if(!good){
+		OrthancPlugins::LogError("Failed to process instance " + id);
+		errors++;
+		return;
+	}
+	if(!modified){
+		unchanged++;
+		return;
+	}
+
+	OrthancPlugins::MemoryBuffer encoded;
+	{
+		StageTimer timer(encode_us);
+		good=dcmfile->SaveToMemoryBuffer(*encoded);
+	}
+	dcmfile.reset();
+	if(!good){
+		OrthancPlugins::LogError("Failed to encode instance " + id);
+		errors++;
+		return;
+	}
+
+	StageTimer timer(store_us);
+	const bool replaced=io([&]{
+		// if the patient changed, the new version gets a new ID and the old one is removed after it was stored
+		// otherwise Orthanc has to replace it in place ("OverwriteInstances"), it's never removed before the new one is there
+		std::string new_id;
+		if(!store(id, encoded.GetData(), encoded.GetSize(), new_id)){
+			if(new_id == id)
+				OrthancPlugins::LogError("Instance " + id + " was not replaced, that needs \"OverwriteInstances\" to be true");
+			return false;
+		}
+		return new_id == id || OrthancPlugins::RestApiDelete("/instances/" + id, false);
+	});
+	if(replaced)
+		changed++;
+	else {
+		OrthancPlugins::LogError("Failed to replace instance " + id);
+		errors++;
+	}
+}
+
+bool Reprocess::step()
+{
+	cancelled = false;
+	if(!listed)
+		list();
+	if(next >= instances.size())
+		return false;
+	const size_t end=std::min(next + BatchSize, instances.size());
+	std::vector<size_t> pending;
+	for(size_t i = next; i < end; i++)
+		if(!done[i])
+			pending.push_back(i);
+	workers.forEach(pending.size(), [this, &pending](size_t p){
+		process(instances[pending[p]]);
+		done[pending[p]] = true;
+	}, cancelled);
+	if(!cancelled)
+		next=end;
+	return next < instances.size();
+}
+
+float Reprocess::progress()const
+{
+	return !listed ? 0 : instances.empty() ? 1 : next / float(instances.size());
+}
@@ -0,0 +1,66 @@
+#ifndef REPROCESS_HPP
+#define REPROCESS_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "workerpool.hpp"
+#include "dicomhandle.hpp"
+
+/**
+ * Applies the patient mapping and tag processing again to instances already stored, e.g. after the rules changed.
+ * Each instance is fetched, parsed (header only if possible), processed, encoded and, if anything changed, stored
+ * again. If that gives it a new ID (the patient changed) the old one is removed afterwards, otherwise Orthanc has to
+ * overwrite it ("OverwriteInstances"). The stored instance is never removed before its replacement is there.
+ * Processing is spread over a pool of threads, while fetching and storing, which hit the storage, are limited to
+ * max_io instances at once.
+ * Like ShadowRebuild the work is done in steps (of a batch of instances), so a job can report progress and be
+ * stopped between steps.
+ */
+class Reprocess
+{
+public:
+	/// changes dcmfile, sets changed if it did, false if it failed
+	typedef std::function<bool(DicomHandle &dcmfile, bool &changed)> Processor;
+	/// set while a thread stores a processed instance, so the received-instance callback doesn't process it again
+	static thread_local bool storing;
+private:
+	WorkerPool workers;
+	std::atomic<bool> cancelled{false};
+	const Processor processor;
+	const bool header_only; // see DicomHandle
+	std::vector<std::string> patients, studies; // resolved to instances by the first step
+	std::vector<std::string> instances;
+	std::vector<char> done;
+	bool listed=false;
+	size_t next=0;
+
+	std::mutex io_mutex;
+	std::condition_variable io_free;
+	unsigned io_running=0;
+	const unsigned max_io;
+
+	void list();
+	void process(const std::string &id);
+	bool store(const std::string &id, const void *data, size_t size, std::string &new_id);
+public:
+	static const size_t BatchSize = 256;
+
+	// instances looked at, instances stored again, instances left as they were, instances that failed
+	std::atomic<uint64_t> files{0}, changed{0}, unchanged{0}, errors{0};
+	// total time (in µs) all threads spent in each stage
+	std::atomic<uint64_t> fetch_us{0}, parse_us{0}, process_us{0}, encode_us{0}, store_us{0};
+
+	/// patients and studies are Orthanc IDs
+	Reprocess(std::vector<std::string> patients, std::vector<std::string> studies, unsigned threads, unsigned max_io, Processor processor, bool header_only);
+	/// does the next part of the work, returns false once everything is done
+	bool step();
+	/// makes a running step return early, the next step will do what's left of its part
+	void cancel(){cancelled=true;}
+	float progress()const;
+};
+
+#endif //REPROCESS_HPP
@@ -0,0 +1,84 @@
+#include "scrub.hpp"
+#include "checksum.hpp"
+#include "shadowtree.hpp"
+#include "fileio.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <ctime>
+
+namespace fs = boost::filesystem;
+
+Scrub::Scrub(std::vector<fs::path> roots, unsigned threads, double max_bytes_per_second):
+	workers(threads, threads), throttle(max_bytes_per_second), tops(topDirectories(roots)){}
+
+void Scrub::report(const fs::path &path, const char *problem)
+{
+	OrthancPlugins::LogWarning(std::string("Scrub: \"") + path.native() + "\" " + problem);
+	std::lock_guard<std::mutex> lock(mutex);
+	if(problems_.size() < MaxProblems)
+		problems_.push_back({path.native(), problem});
+}
+
+void Scrub::check(const fs::path &org)
+{
+	FileDescriptor file=openUntouched(org.c_str()); // or no scrubbed file would ever be cold enough to migrate
+	uint64_t sum, stored;
+	if(!file.good() && errno == ENOENT)
+		return; // removed since we listed the directory
+	if(!file.good() || !fileChecksum(file, sum, &throttle)){
+		unreadable++;
+		report(org, "can't be read");
+		return;
+	}
+	struct stat st;
+	fstat(file, &st);
+	bytes += st.st_size;
+	if(!storedChecksum(org, stored)){
+		// a recent file may still be written (without "DurableWrites" under its final name), its checksum comes later
+		if(st.st_mtime + ChecksumGracePeriod < time(nullptr) && storeChecksum(org, sum))
+			added++;
+	} else if(stored != sum){
+		mismatches++;
+		report(org, "doesn't match its checksum");
+	} else
+		verified++;
+
+	const fs::path shadow = shadow_index.lookup(org);
+	boost::system::error_code ec;
+	if(isBelow(sroot, shadow) && !fs::equivalent(shadow, org, ec)){
+		broken_shadows++;
+		report(shadow, "isn't linked to its original anymore");
+	}
+}
+
+bool Scrub::step()
+{
+	cancelled = false;
+	if(next_top >= tops.size())
+		return false;
+	const std::vector<fs::path> leaves = leafDirectories(tops[next_top]);
+	workers.forEach(leaves.size(), [this, &leaves](size_t i){
+		boost::system::error_code ec;
+		for(fs::directory_iterator it(leaves[i], ec), end; !ec && it != end && !cancelled; it.increment(ec)){
+			if(!isAttachment(*it))
+				continue;
+			files++;
+			check(it->path());
+		}
+	}, cancelled);
+	if(!cancelled)
+		next_top++;
+	return next_top < tops.size();
+}
+
+float Scrub::progress()const
+{
+	return tops.empty() ? 1 : next_top / float(tops.size());
+}
+
+std::vector<Scrub::Problem> Scrub::problems()const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return problems_;
+}
@@ -0,0 +1,51 @@
+#ifndef SCRUB_HPP
+#define SCRUB_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "workerpool.hpp"
+#include "throttle.hpp"
+
+/**
+ * Verifies the files in the storage directories against their stored checksums (see checksum.hpp), and that their
+ * shadow (if indexed) still is the same file. Files without a checksum get one, unless they were changed in the last
+ * ChecksumGracePeriod seconds (they may not be complete yet).
+ * Like ShadowRebuild the work is done in steps, one first level directory per step spread over all threads.
+ */
+class Scrub
+{
+public:
+	struct Problem{std::string path, problem;};
+private:
+	WorkerPool workers;
+	Throttle throttle;
+	std::atomic<bool> cancelled{false};
+	const std::vector<boost::filesystem::path> tops; // first level directories of all roots, one is done per step
+	size_t next_top=0;
+	mutable std::mutex mutex;
+	std::vector<Problem> problems_;
+
+	void report(const boost::filesystem::path &path, const char *problem);
+	void check(const boost::filesystem::path &org);
+public:
+	static const size_t MaxProblems = 1000; // more are counted, but not listed
+	static const time_t ChecksumGracePeriod = 3600;
+
+	// files looked at, bytes read, checksums that matched, checksums added, checksums that didn't match,
+	// files that couldn't be read, shadows that aren't linked to their file anymore
+	std::atomic<uint64_t> files{0}, bytes{0}, verified{0}, added{0}, mismatches{0}, unreadable{0}, broken_shadows{0};
+
+	/// max_bytes_per_second limits how much is read, 0 means unlimited
+	Scrub(std::vector<boost::filesystem::path> roots, unsigned threads, double max_bytes_per_second);
+	/// does the next part of the work, returns false once everything is done
+	bool step();
+	/// makes a running step return early, the next step will redo its part
+	void cancel(){cancelled=true;}
+	float progress()const;
+	std::vector<Problem> problems()const;
+};
+
+#endif //SCRUB_HPP
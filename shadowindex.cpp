@@ -0,0 +1,46 @@
+#include "shadowindex.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <sys/xattr.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+const char *const ShadowAttribute = "user.shadowwriter.shadow";
+}
+
+void ShadowIndex::disable(const boost::filesystem::path &org, int err)
+{
+	if(enabled.exchange(false))
+		OrthancPlugins::LogWarning(
+			std::string("Extended attributes are not supported for \"") + org.native() + "\" (" + strerror(err) +
+			"), shadow paths will not be indexed");
+}
+
+bool ShadowIndex::store(const boost::filesystem::path &org, const boost::filesystem::path &shadow)
+{
+	if(!enabled)
+		return false;
+	const std::string &value = shadow.native();
+	if(setxattr(org.c_str(), ShadowAttribute, value.data(), value.size(), 0) == 0)
+		return true;
+	if(errno == ENOTSUP)
+		disable(org, errno);
+	else
+		OrthancPlugins::LogWarning(
+			std::string("Failed to index shadow of \"") + org.native() + "\" " + strerror(errno));
+	return false;
+}
+
+boost::filesystem::path ShadowIndex::lookup(const boost::filesystem::path &org)
+{
+	if(!enabled)
+		return {};
+	char buffer[4096];
+	const ssize_t len = getxattr(org.c_str(), ShadowAttribute, buffer, sizeof(buffer));
+	if(len < 0){
+		if(errno == ENOTSUP)
+			disable(org, errno);
+		return {}; // ENODATA is a file from before the index, ERANGE a path we wouldn't have written
+	}
+	return std::string(buffer, len);
+}
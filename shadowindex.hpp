@@ -0,0 +1,25 @@
+#ifndef SHADOWINDEX_HPP
+#define SHADOWINDEX_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+
+/**
+ * Persistent uuid -> shadow path index.
+ * The shadow path is stored as extended attribute ("user.shadowwriter.shadow") of the original file. So the entry
+ * lives and dies with the file it describes, survives restarts and looking it up is a single getxattr.
+ * If the filesystem does not support extended attributes the index switches itself off and lookup() always comes
+ * back empty, which makes callers fall back to parsing the file.
+ * Missing entries are filled in from the files by the rebuild (ShadowRebuild::reconcile).
+ */
+class ShadowIndex
+{
+	std::atomic<bool> enabled{true};
+	void disable(const boost::filesystem::path &org, int err);
+public:
+	bool store(const boost::filesystem::path &org, const boost::filesystem::path &shadow);
+	/// returns an empty path if there is no entry for org
+	boost::filesystem::path lookup(const boost::filesystem::path &org);
+};
+
+#endif //SHADOWINDEX_HPP
@@ -0,0 +1,120 @@
+#include "shadowrebuild.hpp"
+#include "shadowtree.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace fs = boost::filesystem;
+
+ShadowRebuild::ShadowRebuild(std::vector<fs::path> roots, unsigned threads, double max_files_per_second):
+	workers(threads, threads), throttle(max_files_per_second), roots(std::move(roots)), tops(topDirectories(this->roots)){}
+
+void ShadowRebuild::reconcile(const fs::path &org)
+{
+	try{
+		fs::path spath = shadow_index.lookup(org);
+		// an index entry from another "ShadowPath" is no entry
+		const bool was_indexed = isBelow(sroot, spath);
+		if(!was_indexed)
+			spath = GetSPathFromFile(org);
+		if(spath.empty()){ // e.g. the JSON attachments, they don't get a shadow
+			skipped++;
+			return;
+		}
+
+		struct stat o, s;
+		if(stat(org.c_str(), &o)){
+			errors++;
+			return;
+		}
+		if(stat(spath.c_str(), &s) == 0){
+			if(s.st_ino != o.st_ino || s.st_dev != o.st_dev)
+				conflicts++;
+			else if(!was_indexed && shadow_index.store(org, spath))
+				indexed++;
+		} else if(createShadow(org, spath, org.filename().native()))
+			linked++;
+		else
+			errors++;
+	} catch(const std::exception &e){
+		OrthancPlugins::LogWarning(std::string("Failed to reconcile \"") + org.native() + "\" " + e.what());
+		errors++;
+	}
+}
+
+void ShadowRebuild::prune(const fs::path &path)
+{
+	boost::system::error_code ec;
+	const fs::file_status status = fs::symlink_status(path, ec);
+	if(fs::is_directory(status)){
+		for(fs::directory_iterator it(path, ec), end; !ec && it != end && !cancelled; it.increment(ec))
+			prune(it->path());
+		if(!cancelled && fs::is_empty(path, ec) && !ec)
+			removeDir(path);
+	} else if(fs::is_regular_file(status)){
+		throttle.acquire();
+		shadows++;
+		// only linked to itself means the original is gone
+		if(fs::hard_link_count(path, ec) == 1 && !ec){
+			if(unlink(path.c_str()) == 0)
+				orphans++;
+			else
+				errors++;
+		}
+	} else if(fs::is_symlink(status)){ // shadows of originals on another storage tier
+		shadows++;
+		if(!fs::exists(path, ec) && !ec){
+			if(unlink(path.c_str()) == 0)
+				orphans++;
+			else
+				errors++;
+		}
+	}
+}
+
+bool ShadowRebuild::step()
+{
+	cancelled = false;
+	if(next_top < tops.size()){
+		const std::vector<fs::path> leaves = leafDirectories(tops[next_top]);
+		workers.forEach(leaves.size(), [this, &leaves](size_t i){
+			boost::system::error_code ec;
+			for(fs::directory_iterator it(leaves[i], ec), end; !ec && it != end && !cancelled; it.increment(ec)){
+				if(!isAttachment(*it))
+					continue;
+				throttle.acquire();
+				files++;
+				reconcile(it->path());
+			}
+		}, cancelled);
+		if(!cancelled)
+			next_top++;
+		return true;
+	}
+	if(!shadow_dirs_listed){
+		boost::system::error_code ec;
+		for(fs::directory_iterator it(sroot, ec), end; !ec && it != end; it.increment(ec))
+			shadow_dirs.push_back(it->path());
+		std::sort(shadow_dirs.begin(), shadow_dirs.end());
+		shadow_dirs_listed = true;
+	}
+	if(next_shadow_dir < shadow_dirs.size()){
+		const size_t chunk = std::min(shadow_dirs.size() - next_shadow_dir, workers.size() * 16);
+		workers.forEach(chunk, [this](size_t i){prune(shadow_dirs[next_shadow_dir + i]);}, cancelled);
+		if(!cancelled)
+			next_shadow_dir += chunk;
+		return true;
+	}
+	return false;
+}
+
+float ShadowRebuild::progress()const
+{
+	if(next_top < tops.size())
+		return next_top / float(tops.size()) / 2;
+	else if(shadow_dirs.empty())
+		return shadow_dirs_listed ? 1 : 0.5f;
+	else
+		return 0.5f + next_shadow_dir / float(shadow_dirs.size()) / 2;
+}
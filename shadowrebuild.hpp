@@ -0,0 +1,45 @@
+#ifndef SHADOWREBUILD_HPP
+#define SHADOWREBUILD_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <vector>
+#include "workerpool.hpp"
+#include "throttle.hpp"
+
+/**
+ * Brings the shadow tree back in line with the storage directory (see shadowtree.hpp).
+ * First every file in the storage directories (oroot and other storage tiers) gets its shadow link (and index entry) if it is missing, then every file in sroot that
+ * isn't linked to anything anymore is removed together with directories that became empty.
+ * The work is done in steps, each step spreading its part over all threads, which pull the next directory whenever
+ * they are done with one. So a plugin job can report progress and be stopped between steps.
+ */
+class ShadowRebuild
+{
+	WorkerPool workers;
+	Throttle throttle;
+	std::atomic<bool> cancelled{false};
+	const std::vector<boost::filesystem::path> roots;
+	const std::vector<boost::filesystem::path> tops; // first level directories of all roots, one is done per step
+	size_t next_top=0;
+	std::vector<boost::filesystem::path> shadow_dirs; // first level directories in sroot, listed when the roots are done
+	bool shadow_dirs_listed=false;
+	size_t next_shadow_dir=0;
+
+	void reconcile(const boost::filesystem::path &org);
+	void prune(const boost::filesystem::path &dir);
+public:
+	// files looked at in oroot and sroot, shadows created, index entries added, files that are no DICOM,
+	// shadows that exist but are a different file, shadows removed, files that failed
+	std::atomic<uint64_t> files{0}, shadows{0}, linked{0}, indexed{0}, skipped{0}, conflicts{0}, orphans{0}, errors{0};
+
+	/// roots are the storage directories to look at, max_files_per_second limits how many files are looked at, 0 means unlimited
+	ShadowRebuild(std::vector<boost::filesystem::path> roots, unsigned threads, double max_files_per_second);
+	/// does the next part of the work, returns false once everything is done
+	bool step();
+	/// makes a running step return early, the next step will redo its part
+	void cancel(){cancelled=true;}
+	float progress()const;
+};
+
+#endif //SHADOWREBUILD_HPP
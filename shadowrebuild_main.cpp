@@ -0,0 +1,51 @@
+#include "shadowtree.hpp"
+#include "shadowrebuild.hpp"
+#include <iostream>
+#include <thread>
+
+// the shared code logs through the plugin wrapper, without Orthanc that goes to stderr
+namespace OrthancPlugins{
+void LogError(const std::string &message){std::cerr << "E: " << message << std::endl;}
+void LogWarning(const std::string &message){std::cerr << "W: " << message << std::endl;}
+void LogInfo(const std::string &){}
+}
+
+int main(int argc, char **argv)
+{
+	// the "StorageLayout" of the plugin, if it's not the default
+	if(argc > 1 && std::string(argv[1]).compare(0, 9, "--layout=") == 0){
+		if(!StorageLayout::parse(argv[1] + 9, layout)){
+			std::cerr << "Invalid layout " << argv[1] + 9 << std::endl;
+			return 1;
+		}
+		argv++;
+		argc--;
+	}
+	if(argc < 3){
+		std::cerr << "Usage: " << argv[0] << " [--layout=<StorageLayout>] <StorageDirectory> <ShadowPath> [threads] [max files per second] [storage tier ...]" << std::endl;
+		return 1;
+	}
+	oroot = argv[1];
+	sroot = argv[2];
+	const unsigned threads = argc > 3 ? std::stoul(argv[3]) : std::thread::hardware_concurrency();
+	const double rate = argc > 4 ? std::stod(argv[4]) : 0;
+	std::vector<boost::filesystem::path> roots{oroot};
+	for(int i = 5; i < argc; i++)
+		roots.push_back(argv[i]);
+	known_dirs.reset(new DirectoryCache(10000));
+
+	ShadowRebuild rebuild(roots, threads, rate);
+	while(rebuild.step())
+		std::cerr << "\r" << int(rebuild.progress() * 100) << "% " << rebuild.files << " files, " << rebuild.linked << " linked" << std::flush;
+
+	std::cout << std::endl
+		<< "files:     " << rebuild.files << std::endl
+		<< "shadows:   " << rebuild.shadows << std::endl
+		<< "linked:    " << rebuild.linked << std::endl
+		<< "indexed:   " << rebuild.indexed << std::endl
+		<< "skipped:   " << rebuild.skipped << std::endl
+		<< "conflicts: " << rebuild.conflicts << std::endl
+		<< "orphans:   " << rebuild.orphans << std::endl
+		<< "errors:    " << rebuild.errors << std::endl;
+	return rebuild.errors ? 2 : 0;
+}
@@ -0,0 +1,232 @@
+#include "shadowtree.hpp"
+#include "dicomscanner.hpp"
+#include "fileio.hpp"
+#include "OrthancPluginCppWrapper.h"
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <set>
+
+namespace fs = boost::filesystem;
+
+fs::path sroot,oroot;
+ShadowIndex shadow_index;
+std::unique_ptr<DirectoryCache> known_dirs;
+std::atomic<uint64_t> syscalls_saved{0};
+
+StorageLayout layout;
+std::unique_ptr<StorageLayout> previous_layout;
+
+fs::path GetOPath(const std::string& uuid, const fs::path &root)
+{
+	return layout.path(uuid, root);
+}
+namespace {
+std::vector<const StorageLayout*> layouts(){
+	std::vector<const StorageLayout*> ret{&layout};
+	if(previous_layout)
+		ret.push_back(previous_layout.get());
+	return ret;
+}
+/// subdirectories of dir that can be a level of a layout with width
+std::vector<fs::path> levelDirectories(const fs::path &dir, unsigned width){
+	std::vector<fs::path> ret;
+	boost::system::error_code ec;
+	for(fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+		if(it->path().filename().native().size() == width && fs::is_directory(it->symlink_status(ec)))
+			ret.push_back(it->path());
+	return ret;
+}
+void collectLeaves(const fs::path &dir, unsigned below, unsigned width, std::set<fs::path> &leaves){
+	if(below == 0)
+		leaves.insert(dir);
+	else for(const fs::path &sub:levelDirectories(dir, width))
+		collectLeaves(sub, below - 1, width, leaves);
+}
+}
+std::vector<fs::path> topDirectories(const std::vector<fs::path> &roots){
+	std::set<fs::path> tops;
+	for(const fs::path &root:roots)
+		for(const StorageLayout *l:layouts())
+			for(const fs::path &base:l->bases(root))
+				for(const fs::path &top:levelDirectories(base, l->width))
+					tops.insert(top);
+	return std::vector<fs::path>(tops.begin(), tops.end());
+}
+std::vector<fs::path> leafDirectories(const fs::path &top){
+	std::set<fs::path> leaves;
+	for(const StorageLayout *l:layouts())
+		if(top.filename().native().size() == l->width)
+			collectLeaves(top, l->depth - 1, l->width, leaves);
+	return std::vector<fs::path>(leaves.begin(), leaves.end());
+}
+bool isAttachment(const fs::directory_entry &entry){
+	boost::system::error_code ec;
+	return entry.path().filename().native().find('.') == std::string::npos && fs::is_regular_file(entry.symlink_status(ec));
+}
+std::string find(DcmSequenceOfItems &dcm,const DcmTagKey& key){
+	DcmStack resultStack;
+	dcm.search(key, resultStack);
+	if(resultStack.empty())
+		return {};
+	auto element=dynamic_cast<DcmElement*>(resultStack.top());
+	if(element == nullptr)
+		return {};
+	OFString ret;
+	element->getOFString(ret,0);
+	return ret.c_str();
+}
+fs::path MakeSPath(
+	const std::string &PatientName, const std::string &PatientID, const std::string &StudyDate, const std::string &StudyTime,
+	const std::string &SequenceNumber, const std::string &SequenceDescription, const std::string &InstanceUid
+){
+	return sroot /
+		(PatientID.empty()?PatientName:PatientID) /
+		((StudyDate.size()>2 ? StudyDate.substr(2) : StudyDate) + "_" + StudyTime.substr(0,6))/
+		(std::string("S")+SequenceNumber+"_"+SequenceDescription)/
+		(InstanceUid+".dcm");
+}
+/// full parse using dcmtk, only used if the DicomScanner can't handle the file
+fs::path GetSPathFull(const void* buffer, size_t size)
+{
+	DcmInputBufferStream is;
+	if (size > 0) {
+		is.setBuffer(buffer, size);
+	}
+	is.setEos();
+
+	DcmFileFormat dcm;
+
+	dcm.transferInit();
+
+	if (dcm.read(is, EXS_Unknown, EGL_noChange, size).good())
+	{
+		dcm.loadAllDataIntoMemory();
+		dcm.transferEnd();
+		return MakeSPath(
+			find(dcm,DcmTagKey(0x0010, 0x0010)),find(dcm,DcmTagKey(0x0010, 0x0020)),
+			find(dcm,DcmTagKey(0x0008, 0x0020)),find(dcm,DcmTagKey(0x0008, 0x0030)),
+			find(dcm,DcmTagKey(0x0020, 0x0011)),find(dcm,DcmTagKey(0x0008, 0x103e)),
+			find(dcm,DcmTagKey(0x0008, 0x0018))
+		);
+	}
+	return {};
+}
+/**
+ * Only looks at the header, stops right after (0020,0011) and never touches pixel data.
+ * If buffer is only the beginning of the file (partial), an empty path is returned unless the scan got past the wanted tags.
+ */
+fs::path ScanSPath(const void* buffer, size_t size, bool partial)
+{
+	typedef DicomScanner S;
+	S scanner({
+		S::makeTag(0x0010, 0x0010),S::makeTag(0x0010, 0x0020),
+		S::makeTag(0x0008, 0x0020),S::makeTag(0x0008, 0x0030),
+		S::makeTag(0x0020, 0x0011),S::makeTag(0x0008, 0x103e),
+		S::makeTag(0x0008, 0x0018)
+	});
+	if(!scanner.scan(buffer,size) || (partial && !scanner.isDeflated() && scanner.stopOffset() >= size))
+		return {};
+	return MakeSPath(
+		scanner.get(S::makeTag(0x0010, 0x0010)),scanner.get(S::makeTag(0x0010, 0x0020)),
+		scanner.get(S::makeTag(0x0008, 0x0020)),scanner.get(S::makeTag(0x0008, 0x0030)),
+		scanner.get(S::makeTag(0x0020, 0x0011)),scanner.get(S::makeTag(0x0008, 0x103e)),
+		scanner.get(S::makeTag(0x0008, 0x0018))
+	);
+}
+fs::path GetSPath(const void* buffer, size_t size)
+{
+	fs::path ret=ScanSPath(buffer,size);
+	return ret.empty() ? GetSPathFull(buffer,size) : ret;
+}
+
+bool makeDirectory(const fs::path &path){
+	boost::system::error_code ec;
+	fs::create_directories(path,ec);
+	if(ec){
+		OrthancPlugins::LogError(std::string("Failed to create directory \"") + path.native() + "\" " + ec.message());
+		return false;
+	} else
+		return true;
+}
+fs::path GetSPathFromFile(const fs::path &org){
+	FileDescriptor file=openUntouched(org.c_str()); // rebuilds read everything, that must not make it look recently used
+	struct stat st;
+	if(!file.good() || fstat(file, &st))
+		return {};
+	const size_t size = st.st_size;
+	std::vector<char> buffer;
+	for(size_t want = std::min<size_t>(size, 64*1024);; want = std::min(size, want*4)){
+		buffer.resize(want);
+		if(preadAll(file, buffer.data(), want, 0) < ssize_t(want))
+			return {};
+		if(want == size)
+			return GetSPath(buffer.data(), want);
+		fs::path found = ScanSPath(buffer.data(), want, true);
+		if(!found.empty())
+			return found;
+	}
+}
+
+bool createShadow(const fs::path &org, const fs::path &spath, const std::string &uuid){
+	if(spath.empty()){
+		OrthancPlugins::LogWarning(
+			std::string("Failed to generate name for shadow of \"") + org.native() + "\" for \"" + uuid + "\" ");
+	} else {
+		// we don't stat spath or its directory if we don't have to, link() will tell us if something is missing
+		const fs::path dir=spath.parent_path();
+		if(!known_dirs->contains(dir.native())){
+			if(!makeDirectory(dir))
+				return false;
+			known_dirs->insert(dir.native());
+		} else
+			syscalls_saved+=2; // stat on spath, and the one create_directories does on an existing directory
+		int erg=link(org.c_str(), spath.c_str());
+		if(erg && errno==ENOENT){ // the directory was removed behind our back
+			known_dirs->erase(dir.native());
+			if(!makeDirectory(dir))
+				return false;
+			known_dirs->insert(dir.native());
+			erg=link(org.c_str(), spath.c_str());
+		}
+		if(erg && errno==EXDEV) // e.g. the original was moved to another storage tier
+			erg=symlink(fs::absolute(org).c_str(), spath.c_str());
+		if(erg == 0){
+			shadow_index.store(org, spath);
+			return true;
+		} else switch (errno) {
+		case EEXIST:return true; // already there (e.g. the instance was stored before)
+		default:
+			OrthancPlugins::LogWarning(
+				std::string("Failed to write shadow \"") + spath.native() + "\" for \"" + uuid + "\" " + strerror(errno)
+			);break;
+		}
+	}
+	return false;
+}
+bool isBelow(const fs::path &root, const fs::path &path){
+	std::string r=root.native();
+	while(r.size()>1 && r.back()=='/')
+		r.pop_back();
+	const std::string &p=path.native();
+	return p.size()>r.size()+1 && p.compare(0,r.size(),r)==0 && p[r.size()]=='/';
+}
+bool removeEmptyDir(const fs::path &dir){
+	// never go above sroot (e.g. for shadows from a previous "ShadowPath")
+	if(!isBelow(sroot,dir))
+		return false;
+	// a plain rmdir does the emptiness check for us
+	if(rmdir(dir.c_str())){
+		if(errno!=ENOTEMPTY && errno!=EEXIST && errno!=ENOENT)
+			OrthancPlugins::LogError(std::string("Failed to remove directory \"") + dir.native() + "\" " + strerror(errno));
+		return false;
+	}
+	known_dirs->erase(dir.native());
+	return true;
+}
+void removeDir(fs::path dir){
+	while(removeEmptyDir(dir))
+		dir=dir.parent_path();
+}
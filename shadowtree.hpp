@@ -0,0 +1,49 @@
+#ifndef SHADOWTREE_HPP
+#define SHADOWTREE_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <memory>
+#include <string>
+#include "shadowindex.hpp"
+#include "directorycache.hpp"
+#include "storagelayout.hpp"
+
+/*
+ * Naming and linking of the shadow tree, shared by the shadow writer plugin and the shadowrebuild tool.
+ * sroot and oroot are the "ShadowPath" and the "StorageDirectory".
+ */
+extern boost::filesystem::path sroot,oroot;
+extern ShadowIndex shadow_index;
+extern std::unique_ptr<DirectoryCache> known_dirs; // directories in sroot we know to exist
+extern std::atomic<uint64_t> syscalls_saved;
+extern StorageLayout layout; // of the storage directories
+extern std::unique_ptr<StorageLayout> previous_layout; // files not moved to the current layout yet are looked for here
+
+/// path of uuid in the storage directory, or in root (e.g. another storage tier)
+boost::filesystem::path GetOPath(const std::string& uuid, const boost::filesystem::path &root=oroot);
+/// the first level directories (of all shards) of roots, in the current and the previous layout
+std::vector<boost::filesystem::path> topDirectories(const std::vector<boost::filesystem::path> &roots);
+/// the directories below top that hold the files, in the current and the previous layout
+std::vector<boost::filesystem::path> leafDirectories(const boost::filesystem::path &top);
+/// true for the files of attachments (not temporary files, the journal, ...)
+bool isAttachment(const boost::filesystem::directory_entry &entry);
+/// path of the shadow for the DICOM file in buffer, empty if that can't be figured out
+boost::filesystem::path GetSPath(const void* buffer, size_t size);
+boost::filesystem::path ScanSPath(const void* buffer, size_t size, bool partial=false);
+/// what GetSPath falls back to if the DicomScanner can't read the file, a full parse with DCMTK
+boost::filesystem::path GetSPathFull(const void* buffer, size_t size);
+/// same as GetSPath, but reads only as much of the file as the header needs
+boost::filesystem::path GetSPathFromFile(const boost::filesystem::path &org);
+
+bool makeDirectory(const boost::filesystem::path &path);
+/// creates the hardlink spath to org, a symlink if org is on another device (if that fails, we complain and return false)
+bool createShadow(const boost::filesystem::path &org, const boost::filesystem::path &spath, const std::string &uuid);
+/// true if path is inside root (and not root itself)
+bool isBelow(const boost::filesystem::path &root, const boost::filesystem::path &path);
+/// removes dir if it is empty (and not sroot), returns false if it didn't
+bool removeEmptyDir(const boost::filesystem::path &dir);
+/// removes dir and its parents up to sroot as long as they are empty
+void removeDir(boost::filesystem::path dir);
+
+#endif //SHADOWTREE_HPP
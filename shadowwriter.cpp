@@ -2,179 +2,355 @@
 #include <boost/filesystem.hpp>
 #include <string>
 #include <future>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <mutex>
 #include <fcntl.h>
-#include <dcmtk/dcmdata/dcfilefo.h>
-#include <dcmtk/dcmdata/dcistrmb.h>
+#include <sys/stat.h>
+#include "shadowtree.hpp"
+#include "fileio.hpp"
+#include "workerpool.hpp"
+#include "linkjournal.hpp"
+#include "shadowrebuild.hpp"
+#include "directoryreaper.hpp"
+#include "readcache.hpp"
+#include "prefetcher.hpp"
+#include "groupcommit.hpp"
+#include "tierstore.hpp"
+#include "tiermigrator.hpp"
+#include "dedupstore.hpp"
+#include "xxhash.hpp"
+#include "compression.hpp"
+#include "checksum.hpp"
+#include "scrub.hpp"
 
 namespace fs = boost::filesystem;
 
-static fs::path sroot,oroot;
+static std::unique_ptr<WorkerPool> workers;
+static std::unique_ptr<LinkJournal> link_journal; // only set if links are created asynchronously
+static std::unique_ptr<DirectoryReaper> reaper; // only set if empty directories are removed in the background
+static std::unique_ptr<ReadCache> read_cache; // only set if "ReadCacheSize" is given
+static std::unique_ptr<SeriesPrefetcher> prefetcher; // only set if "SeriesPrefetch" is given
+static std::unique_ptr<GroupCommit> group_commit; // only set if "DurableWrites" is on
+static const int64_t PreallocateSize=1<<20; // durable writes of at least that size are preallocated
+static std::unique_ptr<TierStore> tiers; // only set if there are "StorageTiers"
+static std::unique_ptr<TierMigrator> migrator;
+static std::unique_ptr<DedupStore> dedup; // only set if "Deduplication" is on
+static int compression_level=0; // attachments that are no DICOM are compressed if not 0
+static const int64_t CompressMinSize=512; // smaller ones are not worth it
+static bool compression_seen=false; // if compression is or ever was on, only then reads look for compressed files
+static std::atomic<uint64_t> compressed_files{0}, compressed_in{0}, compressed_out{0};
+static bool checksums=false; // if "StorageChecksums" are computed by each write
+static std::mutex scrub_mutex;
+static std::shared_ptr<Scrub> last_scrub; // the latest scrub job, for GET /shadowwriter/scrub
+static const size_t MaxDefaultDirectories=1<<20; // bigger layouts are always initialised "Lazy"
 
-fs::path GetOPath(const std::string& uuid)
-{
-	fs::path path = oroot;
-
-	path /= std::string(&uuid[0], &uuid[2]);
-	path /= std::string(&uuid[2], &uuid[4]);
-	path /= uuid;
-
-#if BOOST_HAS_FILESYSTEM_V3 == 1
-	path.make_preferred();
-#endif
-	return path;
-}
-std::string find(DcmSequenceOfItems &dcm,const DcmTagKey& key){
-	DcmStack resultStack;
-	dcm.search(key, resultStack);
-	if(resultStack.empty())
-		return {};
-	auto element=dynamic_cast<DcmElement*>(resultStack.top());
-	if(element == nullptr)
-		return {};
-	OFString ret;
-	element->getOFString(ret,0);
-	return ret.c_str();
-}
-fs::path GetSPath(const void* buffer, size_t size)
-{
-	DcmInputBufferStream is;
-	if (size > 0) {
-		is.setBuffer(buffer, size);
+/// queues creating the shadow of an already written original, the name is taken from the file on disk
+void queueShadow(const std::string &uuid){
+	link_journal->begin(uuid);
+	workers->submit([uuid]{
+		const fs::path org=GetOPath(uuid);
+		createShadow(org, GetSPathFromFile(org), uuid);
+		link_journal->end(uuid);
+	});
+}
+/// creates path and writes content into it, a partially written file is removed again (and the result is not good)
+FileDescriptor writeFile(const fs::path &path, const void *content, int64_t size){
+	const auto create=[&path]{return FileDescriptor(path.c_str(), O_CREAT|O_EXCL|O_WRONLY, DEFFILEMODE);};
+	FileDescriptor file=create();
+	if(!file.good() && errno==ENOENT && makeDirectory(path.parent_path())) // first write into this bucket (or "StorageDirectoryInit" is "Lazy")
+		file=create();
+	if(!file.good()){
+		OrthancPlugins::LogError(std::string("Failed to create \"") + path.native() + "\" " + strerror(errno));
+		return FileDescriptor();
 	}
-	is.setEos();
-
-	DcmFileFormat dcm;
-
-	dcm.transferInit();
-
-	if (dcm.read(is, EXS_Unknown, EGL_noChange, size).good())
-	{
-		dcm.loadAllDataIntoMemory();
-		dcm.transferEnd();
-		auto PatientName = find(dcm,DcmTagKey(0x0010, 0x0010));
-		auto PatientID = find(dcm,DcmTagKey(0x0010, 0x0020));
-		auto StudyDate = find(dcm,DcmTagKey(0x0008, 0x0020));
-		auto StudyTime = find(dcm,DcmTagKey(0x0008, 0x0030));
-		auto SequenceNumber = find(dcm,DcmTagKey(0x0020, 0x0011));
-		auto SequenceDescription = find(dcm,DcmTagKey(0x0008, 0x103e));
-		auto InstanceUid = find(dcm,DcmTagKey(0x0008, 0x0018));
-		return sroot /
-			(PatientID.empty()?PatientName:PatientID) /
-			(StudyDate.substr(2) + "_" + StudyTime.substr(0,6))/
-			(std::string("S")+SequenceNumber+"_"+SequenceDescription)/
-			(InstanceUid+".dcm");
-	}
-	return {};
-}
-
-bool makeDirectory(const fs::path &path){
-	boost::system::error_code ec;
-	fs::create_directories(path,ec);
-	if(ec){
-		OrthancPlugins::LogError(std::string("Failed to create directory \"") + path.native() + "\" " + ec.message());
-		return false;
-	} else
-		return true;
+	// lets the filesystem allocate big files in one go, it's just a hint, a full disk will fail the write anyway
+	if(group_commit && size >= PreallocateSize)
+		fallocate(file, 0, 0, size);
+	const ssize_t written=pwriteAll(file, content, size, 0);
+	if(written<size){
+		OrthancPlugins::LogError(std::string("Failed to write \"") + path.native() + "\" " + (written<0 ? strerror(errno) : "(short write)"));
+		unlink(path.c_str());
+		return FileDescriptor();
+	}
+	// in durable mode the group commit flushes it with the rest of its batch, until then the writeback gets a head start
+	if(group_commit)
+		sync_file_range(file, 0, 0, SYNC_FILE_RANGE_WRITE);
+	return file;
 }
 OrthancPluginErrorCode write(const char *uuid, const void *content, int64_t size, OrthancPluginContentType type){
-	//only do shadow writing if its dicom
+	//only do shadow writing if its dicom, in async mode the link is created after the file was written
 	std::future<fs::path> shadow;
-	if(type == OrthancPluginContentType_Dicom)
-		shadow=std::async(GetSPath,content,size);
+	if(type == OrthancPluginContentType_Dicom && !link_journal)
+		shadow=workers->submit(std::bind(GetSPath,content,size));
 
-	//writing the original
+	//the shadows have to stay DICOM files, all others may be compressed
+	std::vector<char> compressed;
+	if(compression_level && type != OrthancPluginContentType_Dicom && size >= CompressMinSize &&
+		compressContent(content, size, compressed, compression_level)){
+		compressed_files++;
+		compressed_in+=size;
+		compressed_out+=compressed.size();
+		content=compressed.data();
+		size=compressed.size();
+	}
+
+	//writing the original, in durable mode under a temporary name until it is on disk
+	//with deduplication an existing copy of the same content is just linked
 	fs::path org=GetOPath(uuid);
-	auto FILE = open(org.c_str(), O_CREAT|O_EXCL|O_WRONLY,DEFFILEMODE);
-	auto written=write(FILE, content, size);
-	close(FILE);
-	if(written<size) {
-		OrthancPlugins::LogError(std::string("Failed to write \"") + org.native() + "\" " + strerror(errno));
+	const fs::path target=group_commit ? fs::path(org.native()+".tmp") : org;
+	const bool deduplicate=dedup && type == OrthancPluginContentType_Dicom;
+	// of what is on disk, so after compression; dedup needs it up front, for the checksum alone a worker computes it
+	// while the file is written
+	const uint64_t hash=deduplicate ? XXH64::hash(content, size) : 0;
+	std::future<uint64_t> digest;
+	if(checksums && !deduplicate)
+		digest=workers->submit([content, size]{return XXH64::hash(content, size);});
+	const bool linked=deduplicate && dedup->link(hash, content, size, uuid, target);
+	FileDescriptor file; // open until the group commit has flushed it
+	bool stored=linked || (file=writeFile(target, content, size)).good();
+	if(stored && group_commit)
+		stored=group_commit->commit(std::move(file), target, org).get();
+	if(!stored) {
+		if(digest.valid())
+			digest.wait(); // these are still reading content, which goes away once we return
+		if(shadow.valid())
+			shadow.wait();
 		return OrthancPluginErrorCode_CannotWriteFile; //cannot write file
 	}
+	if(deduplicate && !linked)
+		dedup->add(hash, uuid, org);
+	//a linked copy shares the checksum of its blob; if storing it fails the next scrub adds it
+	if(checksums && !linked){
+		const uint64_t sum=digest.valid() ? digest.get() : hash;
+		if(!workers->trySubmit([org, sum]{storeChecksum(org, sum);}))
+			storeChecksum(org, sum); // the queue is full
+	}
 
-	//if we don't write the shadow, we're done here
+	if(type == OrthancPluginContentType_Dicom && link_journal)
+		queueShadow(uuid);
+
+	//if we don't write the shadow now, we're done here
 	if(!shadow.valid())
 		return OrthancPluginErrorCode_Success;
 
-	//creating the link (if that fails, we complain but return "Success" anyways)
-	fs::path spath = shadow.get();
-	if(spath.empty()){
-		OrthancPlugins::LogWarning(
-			std::string("Failed to generate name for shadow of \"") + org.native() + "\" for \"" + uuid + "\" ");
-	} else if(!fs::exists(spath) && makeDirectory(spath.parent_path())){
-		int erg = link(org.c_str(), spath.c_str());
-		switch (erg) {
-		case 0:break;
-		case EXDEV:
-			OrthancPlugins::LogWarning(
-				std::string("Failed to write shadow \"") + spath.native() + "\" for \"" + uuid + "\", must be on the same device"
-			);break;
-		default:
-			OrthancPlugins::LogWarning(
-				std::string("Failed to write shadow \"") + spath.native() + "\" for \"" + uuid + "\" " + strerror(errno)
-			);break;
-		}
+	createShadow(org, shadow.get(), uuid);
+	return OrthancPluginErrorCode_Success;
+}
+/// where the original of uuid is as far as we know (see TierStore::locate)
+fs::path locate(const std::string &uuid){
+	return tiers ? tiers->locate(uuid) : GetOPath(uuid);
+}
+/// opens the original of uuid for reading, org is set to where it was found
+FileDescriptor openOriginal(const char *uuid, fs::path &org){
+	org=locate(uuid);
+	FileDescriptor file(org.c_str(), O_RDONLY);
+	if(file.good() || errno!=ENOENT || !tiers)
+		return file;
+	org=tiers->find(uuid); // not where we thought, it wasn't remembered or just moved
+	return FileDescriptor(org.c_str(), O_RDONLY);
+}
+/// opens org for reading and gets the size of its content (and if it is compressed), logs and returns false if that fails
+bool openForRead(const fs::path &org, const char *uuid, OrthancPluginContentType type, const FileDescriptor &file, int64_t &size, bool &compressed){
+	struct stat st;
+	if(!file.good() || fstat(file, &st)){
+		OrthancPlugins::LogError(std::string("Failed to read \"") + org.native() + "\" for \"" + uuid + "\" " + strerror(errno));
+		return false;
+	}
+	uint64_t inflated;
+	compressed = compression_seen && type != OrthancPluginContentType_Dicom && isCompressed(file, inflated);
+	size = compressed ? int64_t(inflated) : st.st_size;
+	return true;
+}
+/// reads all of the content of file into target
+bool readContent(const fs::path &org, const FileDescriptor &file, bool compressed, void *target, int64_t size){
+	if(compressed ? inflateRange(file, target, size) : preadAll(file, target, size, 0) >= size)
+		return true;
+	OrthancPlugins::LogError(std::string("Failed to read all of \"") + org.native() + "\" " + (compressed ? "(bad compressed data)" : strerror(errno)));
+	return false;
+}
+/// reads the file into the read cache if that is on and takes files of that size
+ReadCache::Data readIntoCache(const char *uuid, const fs::path &org, const FileDescriptor &file, bool compressed, int64_t size){
+	if(!read_cache)
+		return nullptr;
+	if(!read_cache->admits(size)){ // put() would turn it down, but only after reading it into memory
+		read_cache->rejected++;
+		return nullptr;
 	}
+	auto data=std::make_shared<std::vector<char>>(size);
+	if(!readContent(org, file, compressed, data->data(), size))
+		return nullptr;
+	read_cache->put(uuid, data);
+	return data;
+}
+/// the buffer read() answers with, an empty file gets nullptr (malloc(0) may return that as well, it's not a failure)
+bool allocateContent(void **content, int64_t size){
+	*content=size ? malloc(size) : nullptr;
+	return *content != nullptr || size == 0;
+}
+OrthancPluginErrorCode answerCached(void **content, int64_t *size, const ReadCache::Data &cached){
+	*size=cached->size();
+	if(!allocateContent(content, *size))
+		return OrthancPluginErrorCode_NotEnoughMemory;
+	if(*size)
+		memcpy(*content, cached->data(), *size);
 	return OrthancPluginErrorCode_Success;
 }
-OrthancPluginErrorCode read(void **content, int64_t *size, const char *uuid, OrthancPluginContentType ){
-	fs::path org=GetOPath(uuid);
-	boost::system::error_code ec;
-	*size=fs::file_size(org,ec);
-	if(ec){
-		OrthancPlugins::LogError(
-			std::string(
-				"Failed to read \"") + org.native() + "\" for \"" + uuid + "\" " +
-				ec.message()
-		);
+OrthancPluginErrorCode answerCached(OrthancPluginMemoryBuffer64 *target, const ReadCache::Data &cached){
+	if(OrthancPluginCreateMemoryBuffer64(OrthancPlugins::GetGlobalContext(), target, cached->size()) != OrthancPluginErrorCode_Success)
+		return OrthancPluginErrorCode_NotEnoughMemory;
+	memcpy(target->data, cached->data(), cached->size());
+	return OrthancPluginErrorCode_Success;
+}
+OrthancPluginErrorCode readFile(void **content, int64_t *size, const char *uuid, OrthancPluginContentType type){
+	ReadCache::Data cached = read_cache ? read_cache->get(uuid) : nullptr;
+	if(cached)
+		return answerCached(content, size, cached);
+
+	fs::path org;
+	const FileDescriptor file=openOriginal(uuid, org);
+	bool compressed;
+	if(!openForRead(org, uuid, type, file, *size, compressed))
 		return OrthancPluginErrorCode_InexistentFile; //cannot read file
-	}
-	auto FILE = open(org.c_str(), O_RDONLY);
-	*content=malloc(*size);
-	auto red=read(FILE, *content, *size);
-	close(FILE);
-	if(red<*size) {
-		OrthancPlugins::LogError(std::string("Failed to read all of \"") + org.native() + "\" " + strerror(errno));
+	if((cached=readIntoCache(uuid, org, file, compressed, *size)))
+		return answerCached(content, size, cached);
+
+	if(!allocateContent(content, *size))
+		return OrthancPluginErrorCode_NotEnoughMemory;
+	if(!readContent(org, file, compressed, *content, *size)) {
+		free(*content);
 		return OrthancPluginErrorCode_CorruptedFile; //cannot read file
-	} else
-		return OrthancPluginErrorCode_Success;
+	}
+	return OrthancPluginErrorCode_Success;
 }
+OrthancPluginErrorCode readWholeFile(OrthancPluginMemoryBuffer64 *target, const char *uuid, OrthancPluginContentType type){
+	ReadCache::Data cached = read_cache ? read_cache->get(uuid) : nullptr;
+	if(cached)
+		return answerCached(target, cached);
 
-void removeDir(fs::path dir){
-	boost::system::error_code ec;
-	while(fs::is_empty(dir)) {
-		fs::remove(dir, ec);
-		if(ec)
+	fs::path org;
+	const FileDescriptor file=openOriginal(uuid, org);
+	int64_t size;
+	bool compressed;
+	if(!openForRead(org, uuid, type, file, size, compressed))
+		return OrthancPluginErrorCode_InexistentFile;
+	if((cached=readIntoCache(uuid, org, file, compressed, size)))
+		return answerCached(target, cached);
+
+	if(OrthancPluginCreateMemoryBuffer64(OrthancPlugins::GetGlobalContext(), target, size) != OrthancPluginErrorCode_Success)
+		return OrthancPluginErrorCode_NotEnoughMemory;
+	if(!readContent(org, file, compressed, target->data, size)) {
+		OrthancPluginFreeMemoryBuffer64(OrthancPlugins::GetGlobalContext(), target);
+		return OrthancPluginErrorCode_CorruptedFile;
+	}
+	return OrthancPluginErrorCode_Success;
+}
+OrthancPluginErrorCode readFileRange(OrthancPluginMemoryBuffer64 *target, const char *uuid, OrthancPluginContentType type, uint64_t rangeStart){
+	// target was already allocated by the core with the size of the requested range
+	ReadCache::Data cached = read_cache ? read_cache->get(uuid) : nullptr;
+	if(cached){
+		if(rangeStart > cached->size() || cached->size() - rangeStart < target->size){
+			OrthancPlugins::LogError(
+				std::string("Failed to read ") + std::to_string(target->size) + " bytes at " + std::to_string(rangeStart) +
+				" from \"" + uuid + "\" (file is too short)");
+			return OrthancPluginErrorCode_BadRange;
+		}
+		memcpy(target->data, cached->data() + rangeStart, target->size);
+		return OrthancPluginErrorCode_Success;
+	}
+	fs::path org;
+	const FileDescriptor file=openOriginal(uuid, org);
+	if(!file.good()){
+		OrthancPlugins::LogError(std::string("Failed to read \"") + org.native() + "\" for \"" + uuid + "\" " + strerror(errno));
+		return OrthancPluginErrorCode_InexistentFile;
+	}
+	uint64_t inflated;
+	if(compression_seen && type != OrthancPluginContentType_Dicom && isCompressed(file, inflated)){
+		if(rangeStart > inflated || inflated - rangeStart < target->size || !inflateRange(file, target->data, target->size, rangeStart)){
 			OrthancPlugins::LogError(
-				std::string("Failed to remove directory \"") + dir.native() + "\" " + ec.message());
-		dir=dir.parent_path();
-		if(fs::equivalent(dir,oroot))
-			break;
+				std::string("Failed to read ") + std::to_string(target->size) + " bytes at " + std::to_string(rangeStart) +
+				" from compressed \"" + org.native() + "\"");
+			return OrthancPluginErrorCode_BadRange;
+		}
+		return OrthancPluginErrorCode_Success;
 	}
+	const ssize_t red = preadAll(file, target->data, target->size, rangeStart);
+	if(red < 0 || uint64_t(red) < target->size) {
+		OrthancPlugins::LogError(
+			std::string("Failed to read ") + std::to_string(target->size) + " bytes at " + std::to_string(rangeStart) +
+			" from \"" + org.native() + "\" " + (red < 0 ? strerror(errno) : "(file is too short)"));
+		return OrthancPluginErrorCode_BadRange;
+	}
+	return OrthancPluginErrorCode_Success;
+}
+/// the rest of the series of a DICOM file is read ahead once it was read, so that doesn't compete with the read itself
+OrthancPluginErrorCode prefetchAfter(OrthancPluginErrorCode result, const char *uuid, OrthancPluginContentType type){
+	if(prefetcher && type == OrthancPluginContentType_Dicom && result == OrthancPluginErrorCode_Success)
+		prefetcher->read(locate(uuid));
+	return result;
+}
+OrthancPluginErrorCode read(void **content, int64_t *size, const char *uuid, OrthancPluginContentType type){
+	return prefetchAfter(readFile(content, size, uuid, type), uuid, type);
+}
+OrthancPluginErrorCode readWhole(OrthancPluginMemoryBuffer64 *target, const char *uuid, OrthancPluginContentType type){
+	return prefetchAfter(readWholeFile(target, uuid, type), uuid, type);
+}
+OrthancPluginErrorCode readRange(OrthancPluginMemoryBuffer64 *target, const char *uuid, OrthancPluginContentType type, uint64_t rangeStart){
+	// an instance read in ranges starts with its header, the ranges after that don't trigger the prefetch again
+	const OrthancPluginErrorCode result=readFileRange(target, uuid, type, rangeStart);
+	return rangeStart == 0 ? prefetchAfter(result, uuid, type) : result;
 }
-OrthancPluginErrorCode remove(const char *uuid, OrthancPluginContentType ){
-	void *content = nullptr;
-	int64_t size;
-	fs::path shadow;
-	if(read(&content,&size,uuid,OrthancPluginContentType_Unknown)==OrthancPluginErrorCode_Success)
-		shadow = GetSPath(content,size);
 
-	if(content)
-		free(content);
+/// removes org and its shadow, returns false (with errno set) if org couldn't be removed
+bool removeFiles(const char *uuid, const fs::path &org){
+	fs::path shadow=shadow_index.lookup(org);
 
-	fs::path org=GetOPath(uuid);
+	//not indexed (e.g. stored before there was an index), so we have to figure it out from the file itself
+	if(shadow.empty())
+		shadow = GetSPathFromFile(org);
 
-	//if we have a shadow (aka we could read the file, figure out the path and its actually linking to org)
-	if(fs::equivalent(shadow,org)) {
+	//if other attachments still share the content, the shadow (and the blob) stays
+	if(dedup && dedup->release(org, shadow))
+		return true;
+
+	//if we have a shadow (aka we could figure out the path and its actually linking to org)
+	boost::system::error_code ec;
+	if(!shadow.empty() && fs::equivalent(shadow,org,ec)) {
 		if(unlink(shadow.c_str())){
 			OrthancPlugins::LogWarning(
 				std::string("Failed to delete shadow \"") + shadow.native() + "\" for \"" + uuid + "\" " +
 					strerror(errno)
 			);
-		} else
+		} else if(reaper)
+			reaper->add(shadow.parent_path());
+		else
 			removeDir(shadow.parent_path());
 	}
-	if(unlink(org.c_str())){
+	return unlink(org.c_str()) == 0;
+}
+/// removes what an interrupted move to another tier left of uuid besides org: the copy (and its shadow, if it was already re-pointed) or the partial copy
+void removeLeftoverCopies(const char *uuid, const fs::path &org){
+	for(const fs::path &root:tiers->roots()){
+		const fs::path copy=GetOPath(uuid, root);
+		if(copy==org)
+			continue;
+		unlink((copy.native()+".tmp").c_str());
+		struct stat st;
+		if(lstat(copy.c_str(), &st)==0 && !removeFiles(uuid, copy))
+			OrthancPlugins::LogWarning(std::string("Failed to delete leftover copy \"") + copy.native() + "\" for \"" + uuid + "\" " + strerror(errno));
+	}
+}
+OrthancPluginErrorCode remove(const char *uuid, OrthancPluginContentType ){
+	if(read_cache)
+		read_cache->erase(uuid);
+	fs::path org=tiers ? tiers->find(uuid) : GetOPath(uuid);
+	bool removed=removeFiles(uuid, org);
+	if(!removed && errno==ENOENT && tiers){ // moved by the migrator or relayout after we found it, so look again
+		org=tiers->find(uuid);
+		removed=removeFiles(uuid, org);
+	}
+	if(!removed){
 		OrthancPlugins::LogError(
 			std::string("Failed to delete \"") +
 			org.native() + "\" for \"" + uuid + "\" " +
@@ -182,27 +358,298 @@ OrthancPluginErrorCode remove(const char *uuid, OrthancPluginContentType ){
 		);
 		return OrthancPluginErrorCode_CorruptedFile;
 	}
+	if(tiers && tiers->roots().size()>1)
+		removeLeftoverCopies(uuid, org);
+	if(tiers)
+		tiers->forget(uuid);
 	return OrthancPluginErrorCode_Success;
 }
 
-template<int DEPTH=0> bool createDefaultPaths(const fs::path &root){
+/// name of directory id on a level of the layout
+std::string levelName(size_t id){
+	char name[8];
+	snprintf(name,sizeof(name),"%.*zx",int(layout.width),id);
+	return name;
+}
+/// number of directories in a complete layout
+size_t directoryCount(){
+	size_t count=0, level=1;
+	for(unsigned depth=0;depth<layout.depth;depth++)
+		count+=(level*=layout.fanOut());
+	return count*layout.bases(oroot).size();
+}
+/// creates all directories of the layout below dir (which is on level)
+bool createDefaultPaths(const fs::path &dir, unsigned level=0){
 	boost::system::error_code ec;
-	for(uint16_t id=0;id<0x100;id++){
-		char id_str[5];
-		snprintf(id_str,4,"%.2x",id);
-		const fs::path path=root/id_str;
+	for(size_t id=0;id<layout.fanOut();id++){
+		const fs::path path=dir/levelName(id);
 		fs::create_directories(path,ec);
 		if(ec) {
 			OrthancPlugins::LogError(
 				std::string("Failed to create default directory \"") + path.native()+ "(" + ec.message() + ")");
 			return false;
 		}
-		if(DEPTH<1)
-			createDefaultPaths<DEPTH+1>(path);
+		if(level+1<layout.depth && !createDefaultPaths(path,level+1))
+			return false;
+	}
+	return true;
+}
+/// same result as createDefaultPaths, but lists what is there first and only creates what is missing
+bool createMissingBelow(const fs::path &dir, unsigned level){
+	boost::system::error_code ec;
+	std::vector<bool> present(layout.fanOut(),false);
+	for(fs::directory_iterator it(dir,ec),end;!ec && it!=end;it.increment(ec)){
+		// only names levelName would give, strtoul also takes signs, spaces or upper case
+		const std::string name=it->path().filename().native();
+		if(name.size()!=layout.width || name.find_first_not_of("0123456789abcdef")!=std::string::npos)
+			continue;
+		const unsigned long sub=strtoul(name.c_str(),nullptr,16);
+		if(sub<present.size())
+			present[sub]=true;
+	}
+	ec.clear();
+	for(size_t sub=0;sub<layout.fanOut();sub++){
+		const fs::path path=dir/levelName(sub);
+		if(!present[sub])
+			fs::create_directory(path,ec);
+		if(ec) {
+			OrthancPlugins::LogError(
+				std::string("Failed to create default directory \"") + path.native()+ "(" + ec.message() + ")");
+			return false;
+		}
+		if(level+1<layout.depth && !createMissingBelow(path,level+1))
+			return false;
+	}
+	return true;
+}
+/// createMissingBelow for root (and all its shards), the first level is done in parallel
+bool createMissingPaths(const fs::path &root){
+	std::atomic<bool> good{true};
+	for(const fs::path &base:layout.bases(root)){
+		std::vector<std::future<void>> done;
+		for(size_t id=0;id<layout.fanOut();id++){
+			done.push_back(workers->submit([&base,&good,id]{
+				const fs::path path=base/levelName(id);
+				boost::system::error_code ec;
+				fs::create_directories(path,ec);
+				if(ec) {
+					OrthancPlugins::LogError(
+						std::string("Failed to create default directory \"") + path.native()+ "(" + ec.message() + ")");
+					good=false;
+				} else if(layout.depth>1 && !createMissingBelow(path,1))
+					good=false;
+			}));
+		}
+		for(auto &d:done)
+			d.get();
+	}
+	return good;
+}
+
+/// all storage directories, the hot tier first
+std::vector<fs::path> storageRoots(){
+	return tiers ? tiers->roots() : std::vector<fs::path>{oroot};
+}
+/// reads the optional JSON body of a POST, answers and returns false if it isn't one
+bool parsePost(OrthancPluginRestOutput* output, const OrthancPluginHttpRequest* request, Json::Value &body){
+	if(request->method != OrthancPluginHttpMethod_Post){
+		OrthancPlugins::AnswerMethodNotAllowed(output, "POST");
+		return false;
+	}
+	if(request->bodySize){
+		static const std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+		const char *begin=static_cast<const char*>(request->body);
+		std::string errs;
+		if(!reader->parse(begin,begin+request->bodySize,&body,&errs)){
+			OrthancPlugins::AnswerHttpError(400, output);
+			return false;
+		}
 	}
 	return true;
 }
-template<> bool createDefaultPaths<2>(const fs::path &root){return true;}//terminator
+/// answers with the ID and path of the submitted job
+void answerJob(OrthancPluginRestOutput* output, OrthancPlugins::OrthancJob *job){
+	Json::Value answer;
+	answer["ID"]=OrthancPlugins::OrthancJob::Submit(job,0);
+	answer["Path"]="/jobs/"+answer["ID"].asString();
+	OrthancPlugins::AnswerJson(answer, output);
+}
+
+/// runs ShadowRebuild as Orthanc job, so it shows up in /jobs and can be paused or canceled there
+class RebuildJob:public OrthancPlugins::OrthancJob{
+	const unsigned threads;
+	const double max_files_per_second;
+	std::unique_ptr<ShadowRebuild> rebuild;
+	void update(){
+		Json::Value content;
+		content["Files"]=Json::UInt64(rebuild->files);
+		content["Shadows"]=Json::UInt64(rebuild->shadows);
+		content["Linked"]=Json::UInt64(rebuild->linked);
+		content["Indexed"]=Json::UInt64(rebuild->indexed);
+		content["Skipped"]=Json::UInt64(rebuild->skipped);
+		content["Conflicts"]=Json::UInt64(rebuild->conflicts);
+		content["Orphans"]=Json::UInt64(rebuild->orphans);
+		content["Errors"]=Json::UInt64(rebuild->errors);
+		UpdateContent(content);
+		UpdateProgress(rebuild->progress());
+	}
+public:
+	RebuildJob(unsigned threads, double max_files_per_second):
+		OrthancJob("ShadowRebuild"),threads(threads),max_files_per_second(max_files_per_second){Reset();}
+	OrthancPluginJobStepStatus Step() override{
+		const bool more=rebuild->step();
+		update();
+		return more ? OrthancPluginJobStepStatus_Continue : OrthancPluginJobStepStatus_Success;
+	}
+	void Stop(OrthancPluginJobStopReason) override{rebuild->cancel();}
+	void Reset() override{
+		rebuild.reset(new ShadowRebuild(storageRoots(),threads,max_files_per_second));
+		update();
+	}
+};
+/// POST starts a rebuild of the shadow tree, optionally with {"Threads":..., "MaxFilesPerSecond":...}
+void postRebuild(OrthancPluginRestOutput* output, const char* /*url*/, const OrthancPluginHttpRequest* request){
+	Json::Value body;
+	if(!parsePost(output, request, body))
+		return;
+	const unsigned threads=body.get("Threads",std::thread::hardware_concurrency()).asUInt();
+	const double rate=body.get("MaxFilesPerSecond",0).asDouble();
+	answerJob(output, new RebuildJob(threads,rate));
+}
+
+Json::Value scrubReport(const Scrub &scrub){
+	Json::Value report;
+	report["Files"]=Json::UInt64(scrub.files);
+	report["Bytes"]=Json::UInt64(scrub.bytes);
+	report["Verified"]=Json::UInt64(scrub.verified);
+	report["Added"]=Json::UInt64(scrub.added);
+	report["Mismatches"]=Json::UInt64(scrub.mismatches);
+	report["Unreadable"]=Json::UInt64(scrub.unreadable);
+	report["BrokenShadows"]=Json::UInt64(scrub.broken_shadows);
+	report["Progress"]=scrub.progress();
+	Json::Value &problems=report["Problems"]=Json::arrayValue;
+	for(const Scrub::Problem &p:scrub.problems()){
+		Json::Value problem;
+		problem["Path"]=p.path;
+		problem["Problem"]=p.problem;
+		problems.append(problem);
+	}
+	return report;
+}
+/// runs Scrub as Orthanc job, the latest one can also be looked at with GET /shadowwriter/scrub
+class ScrubJob:public OrthancPlugins::OrthancJob{
+	const unsigned threads;
+	const double max_bytes_per_second;
+	std::shared_ptr<Scrub> scrub;
+	void update(){
+		UpdateContent(scrubReport(*scrub));
+		UpdateProgress(scrub->progress());
+	}
+public:
+	ScrubJob(unsigned threads, double max_bytes_per_second):
+		OrthancJob("ShadowScrub"),threads(threads),max_bytes_per_second(max_bytes_per_second){Reset();}
+	OrthancPluginJobStepStatus Step() override{
+		const bool more=scrub->step();
+		update();
+		return more ? OrthancPluginJobStepStatus_Continue : OrthancPluginJobStepStatus_Success;
+	}
+	void Stop(OrthancPluginJobStopReason) override{scrub->cancel();}
+	void Reset() override{
+		scrub=std::make_shared<Scrub>(storageRoots(),threads,max_bytes_per_second);
+		{
+			std::lock_guard<std::mutex> lock(scrub_mutex);
+			last_scrub=scrub;
+		}
+		update();
+	}
+};
+/// POST starts verifying all files, optionally with {"Threads":..., "MaxMegabytesPerSecond":...}, GET shows the results of the latest run
+void scrubStorage(OrthancPluginRestOutput* output, const char* /*url*/, const OrthancPluginHttpRequest* request){
+	if(request->method == OrthancPluginHttpMethod_Get){
+		std::shared_ptr<Scrub> scrub;
+		{
+			std::lock_guard<std::mutex> lock(scrub_mutex);
+			scrub=last_scrub;
+		}
+		if(scrub)
+			OrthancPlugins::AnswerJson(scrubReport(*scrub), output);
+		else
+			OrthancPlugins::AnswerHttpError(404, output);
+		return;
+	}
+	Json::Value body;
+	if(!parsePost(output, request, body))
+		return;
+	const unsigned threads=body.get("Threads",2).asUInt();
+	const double rate=body.get("MaxMegabytesPerSecond",50).asDouble()*(1<<20);
+	answerJob(output, new ScrubJob(threads,rate));
+}
+
+Json::Value statistics(){
+	Json::Value ret;
+	Json::Value &dirs=ret["DirectoryCache"];
+	dirs["Hits"]=Json::UInt64(known_dirs->hits);
+	dirs["Misses"]=Json::UInt64(known_dirs->misses);
+	dirs["Invalidations"]=Json::UInt64(known_dirs->invalidations);
+	dirs["SyscallsSaved"]=Json::UInt64(syscalls_saved);
+	if(read_cache){
+		Json::Value &cache=ret["ReadCache"];
+		cache["Hits"]=Json::UInt64(read_cache->hits);
+		cache["Misses"]=Json::UInt64(read_cache->misses);
+		cache["Evictions"]=Json::UInt64(read_cache->evictions);
+		cache["Rejected"]=Json::UInt64(read_cache->rejected);
+		cache["Size"]=Json::UInt64(read_cache->size());
+	}
+	if(prefetcher){
+		Json::Value &prefetch=ret["SeriesPrefetch"];
+		prefetch["Series"]=Json::UInt64(prefetcher->series);
+		prefetch["Files"]=Json::UInt64(prefetcher->files);
+		prefetch["Dropped"]=Json::UInt64(prefetcher->dropped);
+	}
+	if(group_commit){
+		Json::Value &durable=ret["DurableWrites"];
+		durable["Batches"]=Json::UInt64(group_commit->batches);
+		durable["Files"]=Json::UInt64(group_commit->files);
+		durable["Leftovers"]=Json::UInt64(group_commit->leftovers);
+	}
+	if(tiers){
+		Json::Value &tiering=ret["StorageTiers"];
+		tiering["Lookups"]=Json::UInt64(tiers->lookups);
+		tiering["Probes"]=Json::UInt64(tiers->probes);
+		if(migrator){ // it's already gone when the final statistics are logged
+			tiering["Moved"]=Json::UInt64(migrator->files);
+			tiering["MovedBytes"]=Json::UInt64(migrator->bytes);
+			tiering["Errors"]=Json::UInt64(migrator->errors);
+		}
+	}
+	if(dedup){
+		Json::Value &deduplication=ret["Deduplication"];
+		deduplication["Hits"]=Json::UInt64(dedup->hits);
+		deduplication["BytesSaved"]=Json::UInt64(dedup->saved);
+		deduplication["Blobs"]=Json::UInt64(dedup->added);
+		deduplication["Mismatches"]=Json::UInt64(dedup->mismatches);
+		deduplication["Released"]=Json::UInt64(dedup->released);
+	}
+	if(compression_level){
+		Json::Value &compression=ret["Compression"];
+		compression["Files"]=Json::UInt64(compressed_files);
+		compression["BytesIn"]=Json::UInt64(compressed_in);
+		compression["BytesOut"]=Json::UInt64(compressed_out);
+	}
+	if(reaper){
+		Json::Value &cleanup=ret["DirectoryCleanup"];
+		cleanup["Queued"]=Json::UInt64(reaper->added);
+		cleanup["Checked"]=Json::UInt64(reaper->checked);
+		cleanup["Removed"]=Json::UInt64(reaper->removed);
+	}
+	return ret;
+}
+void getStatistics(OrthancPluginRestOutput* output, const char* /*url*/, const OrthancPluginHttpRequest* request){
+	if(request->method != OrthancPluginHttpMethod_Get)
+		OrthancPlugins::AnswerMethodNotAllowed(output, "GET");
+	else
+		OrthancPlugins::AnswerJson(statistics(), output);
+}
 
 extern "C"
 {
@@ -223,7 +670,7 @@ ORTHANC_PLUGINS_API int32_t OrthancPluginInitialize(OrthancPluginContext* c)
 	oroot=OrthancPlugins::OrthancConfiguration().GetStringValue("StorageDirectory","");
 
 	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("StorageCompression",false)){
-		OrthancPlugins::LogError("\"StorageCompression\" is switched on. Using the shadow writer plugin would be pointless");
+		OrthancPlugins::LogError("\"StorageCompression\" is switched on. Using the shadow writer plugin would be pointless (use \"CompressAttachments\" instead)");
 		return -1;
 	}
 
@@ -236,17 +683,144 @@ ORTHANC_PLUGINS_API int32_t OrthancPluginInitialize(OrthancPluginContext* c)
 		OrthancPlugins::LogError("Loaded shadow writer plugin. But \"ShadowPath\" in the configuration is not set");
 		return -1;
 	}
-	OrthancPlugins::LogWarning("Creating default directories in " +oroot.native() +"/..");
-	if(!createDefaultPaths(oroot))
+	// how the files are arranged below "StorageDirectory" (e.g. "3x2:disk0,disk1" see StorageLayout), and how they were
+	// before if they are being moved to a new layout
+	const std::string layout_spec=OrthancPlugins::OrthancConfiguration().GetStringValue("StorageLayout","2x2");
+	const std::string previous_spec=OrthancPlugins::OrthancConfiguration().GetStringValue("StoragePreviousLayout","");
+	if(!StorageLayout::parse(layout_spec,layout)){
+		OrthancPlugins::LogError("Invalid \"StorageLayout\" \""+layout_spec+"\", must be like \"2x2\" or \"3x2:disk0,disk1\"");
+		return -1;
+	}
+	if(!previous_spec.empty()){
+		previous_layout.reset(new StorageLayout);
+		if(!StorageLayout::parse(previous_spec,*previous_layout)){
+			OrthancPlugins::LogError("Invalid \"StoragePreviousLayout\" \""+previous_spec+"\", must be like \"2x2\" or \"3x2:disk0,disk1\"");
+			return -1;
+		}
+	}
+	known_dirs.reset(new DirectoryCache(OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ShadowDirectoryCacheSize",10000)));
+	const unsigned threads=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ShadowWorkers",std::thread::hardware_concurrency());
+	const unsigned queue=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ShadowQueueSize",1024);
+	workers.reset(new WorkerPool(threads,queue));
+
+	// "Eager" creates all of them one by one, "Missing" looks what's there first, "Lazy" leaves it to write()
+	std::string init=OrthancPlugins::OrthancConfiguration().GetStringValue("StorageDirectoryInit","Eager");
+	if(init!="Lazy" && directoryCount()>MaxDefaultDirectories){
+		OrthancPlugins::LogWarning("Storage layout "+layout.str()+" has too many directories to create them in advance, using \"Lazy\"");
+		init="Lazy";
+	}
+	const auto init_start=std::chrono::steady_clock::now();
+	if(init=="Eager"){
+		OrthancPlugins::LogWarning("Creating default directories in " +oroot.native() +"/..");
+		for(const fs::path &base:layout.bases(oroot))
+			if(!createDefaultPaths(base))
+				return -1;
+	} else if(init=="Missing"){
+		OrthancPlugins::LogWarning("Creating missing default directories in " +oroot.native() +"/..");
+		if(!createMissingPaths(oroot))
+			return -1;
+	} else if(init!="Lazy"){
+		OrthancPlugins::LogError("Unknown \"StorageDirectoryInit\" \""+init+"\", must be \"Eager\", \"Missing\" or \"Lazy\"");
 		return -1;
+	}
+	OrthancPlugins::LogWarning(
+		"Storage directory initialisation (" + init + ") took " +
+		std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-init_start).count()) + "ms"
+	);
+	// in MB, entries bigger than "ReadCacheMaxEntrySize" are not cached
+	const unsigned read_cache_size=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ReadCacheSize",0);
+	if(read_cache_size){
+		const unsigned max_entry=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ReadCacheMaxEntrySize",std::max(read_cache_size/16,1u));
+		read_cache.reset(new ReadCache(size_t(read_cache_size)<<20,size_t(max_entry)<<20));
+	}
+	// files are only reported as written once they are on disk, "DurableWriteWindow" (ms) is how long to wait for others to flush them together
+	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("DurableWrites",false)){
+		const unsigned window=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("DurableWriteWindow",5);
+		group_commit.reset(new GroupCommit(std::chrono::milliseconds(window)));
+	}
+	// colder storage directories, files not accessed for "Age" days are moved from the one before into it
+	const Json::Value &tier_cfg=OrthancPlugins::OrthancConfiguration().GetJson()["StorageTiers"];
+	std::vector<fs::path> roots{oroot};
+	std::vector<std::chrono::seconds> ages{std::chrono::seconds(0)};
+	if(tier_cfg.isArray())
+		for(const Json::Value &tier:tier_cfg){
+			if(!tier.isObject() || !tier["Path"].isString() || !tier["Age"].isNumeric()){
+				OrthancPlugins::LogError("Every entry of \"StorageTiers\" needs a \"Path\" and an \"Age\" (in days)");
+				return -1;
+			}
+			roots.push_back(tier["Path"].asString());
+			ages.push_back(std::chrono::seconds(std::chrono::seconds::rep(tier["Age"].asDouble()*24*3600)));
+		}
+	if(group_commit)
+		group_commit->removeLeftovers(roots);
+	// files still in the previous layout are found by the tier store as well
+	if(roots.size()>1 || previous_layout)
+		tiers.reset(new TierStore(roots,OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("TierLocationCacheSize",100000)));
+	if(roots.size()>1){
+		// in MB/s and seconds
+		const unsigned rate=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("TierMigrationRate",20);
+		const unsigned interval=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("TierMigrationInterval",3600);
+		migrator.reset(new TierMigrator(*tiers,ages,double(rate)*(1<<20),std::chrono::seconds(interval)));
+	}
+	// zlib level (1..9) for all attachments but the DICOM files, which have to stay plain for the shadows
+	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("CompressAttachments",false))
+		compression_level=std::min(std::max(OrthancPlugins::OrthancConfiguration().GetIntegerValue("CompressionLevel",3),1),9);
+	// a marker in the storage directory remembers that compression was on, so its files are still read once it is switched off
+	const fs::path compression_marker=oroot/"shadowwriter.compressed";
+	if(compression_level && !FileDescriptor(compression_marker.c_str(), O_CREAT|O_WRONLY, DEFFILEMODE).good())
+		OrthancPlugins::LogError("Failed to create \"" + compression_marker.native() + "\" " + strerror(errno));
+	boost::system::error_code ec;
+	compression_seen=compression_level || fs::exists(compression_marker, ec);
+	// checksums of new files are computed while writing them, POST /shadowwriter/scrub verifies them
+	checksums=OrthancPlugins::OrthancConfiguration().GetBooleanValue("StorageChecksums",false);
+	// identical DICOM files are stored only once (needs extended attributes)
+	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("Deduplication",false))
+		dedup.reset(new DedupStore(oroot));
+	// max number of files of a series to read ahead
+	const unsigned prefetch=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("SeriesPrefetch",0);
+	if(prefetch)
+		prefetcher.reset(new SeriesPrefetcher(prefetch,16));
+	const unsigned cleanup_delay=OrthancPlugins::OrthancConfiguration().GetUnsignedIntegerValue("ShadowCleanupDelay",2000);
+	if(cleanup_delay)
+		reaper.reset(new DirectoryReaper(std::chrono::milliseconds(cleanup_delay)));
+	if(OrthancPlugins::OrthancConfiguration().GetBooleanValue("ShadowAsyncLinks",false)){
+		link_journal.reset(new LinkJournal(oroot/"shadowwriter.journal"));
+		const auto leftover=link_journal->open();
+		if(!leftover.empty())
+			OrthancPlugins::LogWarning("Replaying "+std::to_string(leftover.size())+" shadow links left pending by the last run");
+		for(const auto &uuid:leftover)
+			queueShadow(uuid);
+	}
 
-	OrthancPluginRegisterStorageArea(c,write,read,remove);
+#if ORTHANC_PLUGINS_VERSION_IS_ABOVE(1, 9, 0)
+	// range reads let the core fetch e.g. only the header of an instance
+	if(OrthancPluginCheckVersionAdvanced(c, 1, 9, 0))
+		OrthancPluginRegisterStorageArea2(c,write,readWhole,readRange,remove);
+	else
+#endif
+		OrthancPluginRegisterStorageArea(c,write,read,remove);
+	OrthancPlugins::RegisterRestCallback<getStatistics>("/shadowwriter/statistics", true);
+	OrthancPlugins::RegisterRestCallback<postRebuild>("/shadowwriter/rebuild", true);
+	OrthancPlugins::RegisterRestCallback<scrubStorage>("/shadowwriter/scrub", true);
 	OrthancPlugins::LogInfo(std::string("Loaded shadow writer plugin. Shadow root is ")+sroot.native());
 	return 0;
 }
 
 
-ORTHANC_PLUGINS_API void OrthancPluginFinalize(){}
+ORTHANC_PLUGINS_API void OrthancPluginFinalize(){
+	prefetcher.reset();
+	migrator.reset();
+	workers.reset(); // finishes pending links before the journal goes
+	link_journal.reset();
+	reaper.reset();
+	group_commit.reset();
+	OrthancPlugins::LogInfo("Shadow writer statistics: "+statistics().toStyledString());
+	known_dirs.reset();
+	read_cache.reset();
+	tiers.reset();
+	dedup.reset();
+	last_scrub.reset();
+}
 ORTHANC_PLUGINS_API const char* OrthancPluginGetName(){return "shadow writer";}
 ORTHANC_PLUGINS_API const char* OrthancPluginGetVersion(){return "0.0";}
 }
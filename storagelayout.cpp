@@ -0,0 +1,70 @@
+#include "storagelayout.hpp"
+#include "xxhash.hpp"
+#include <cstdlib>
+
+namespace fs = boost::filesystem;
+
+fs::path StorageLayout::base(const std::string &uuid, const fs::path &root)const
+{
+	if(shards.empty())
+		return root;
+	return root / shards[XXH64::hash(uuid.data(), uuid.size()) % shards.size()];
+}
+
+fs::path StorageLayout::path(const std::string &uuid, const fs::path &root)const
+{
+	fs::path path = base(uuid, root);
+	for(unsigned level = 0; level < depth; level++)
+		path /= uuid.substr(level * width, width);
+	path /= uuid;
+
+#if BOOST_HAS_FILESYSTEM_V3 == 1
+	path.make_preferred();
+#endif
+	return path;
+}
+
+std::vector<fs::path> StorageLayout::bases(const fs::path &root)const
+{
+	if(shards.empty())
+		return {root};
+	std::vector<fs::path> ret;
+	for(const std::string &shard:shards)
+		ret.push_back(root / shard);
+	return ret;
+}
+
+std::string StorageLayout::str()const
+{
+	std::string ret = std::to_string(depth) + "x" + std::to_string(width);
+	for(size_t i = 0; i < shards.size(); i++)
+		ret += (i ? "," : ":") + shards[i];
+	return ret;
+}
+
+bool StorageLayout::parse(const std::string &spec, StorageLayout &layout)
+{
+	char *end;
+	const unsigned long depth = strtoul(spec.c_str(), &end, 10);
+	if(*end != 'x')
+		return false;
+	const unsigned long width = strtoul(end + 1, &end, 10);
+	// the levels are taken from the first part of the uuid, which has 8 characters before the first dash
+	if(depth < 1 || width < 1 || width > 4 || depth * width > 8 || (*end != '\0' && *end != ':'))
+		return false;
+	std::vector<std::string> shards;
+	if(*end == ':'){
+		std::string list(end + 1);
+		for(size_t pos = 0, next; pos <= list.size(); pos = next + 1){
+			next = std::min(list.find(',', pos), list.size());
+			const std::string shard = list.substr(pos, next - pos);
+			if(shard.empty() || shard.find('/') != std::string::npos || shard.find('.') != std::string::npos)
+				return false;
+			shards.push_back(shard);
+		}
+	}
+	layout.depth = unsigned(depth);
+	layout.width = unsigned(width);
+	layout.shards = shards;
+	return true;
+}
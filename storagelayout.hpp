@@ -0,0 +1,31 @@
+#ifndef STORAGELAYOUT_HPP
+#define STORAGELAYOUT_HPP
+
+#include <boost/filesystem.hpp>
+#include <string>
+#include <vector>
+
+/**
+ * How the files of the attachments are arranged below a storage directory:
+ * root[/shard]/<depth levels of width characters of the uuid>/uuid
+ * The shards are subdirectories of the root (typically mount points of separate disks), the one for a uuid is picked by
+ * its hash. The default (depth 2, width 2, no shards) is Orthanc's own layout.
+ */
+struct StorageLayout
+{
+	unsigned depth=2, width=2;
+	std::vector<std::string> shards;
+
+	/// root, or the shard of root uuid is in
+	boost::filesystem::path base(const std::string &uuid, const boost::filesystem::path &root)const;
+	boost::filesystem::path path(const std::string &uuid, const boost::filesystem::path &root)const;
+	/// root, or all its shards
+	std::vector<boost::filesystem::path> bases(const boost::filesystem::path &root)const;
+	/// number of directories on each level
+	size_t fanOut()const{return size_t(1) << (4 * width);}
+	std::string str()const;
+	/// reads "<depth>x<width>[:<shard>,<shard>...]" e.g. "2x2" or "3x2:disk0,disk1", returns false if spec is not valid
+	static bool parse(const std::string &spec, StorageLayout &layout);
+};
+
+#endif //STORAGELAYOUT_HPP
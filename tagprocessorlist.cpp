@@ -3,22 +3,138 @@
 //
 
 #include "tagprocessorlist.hpp"
+#include <algorithm>
+#include <tuple>
+
+namespace {
+/// values fetched by FixTags, kept per thread so they don't have to be allocated again for every instance
+struct Scratch{
+	std::vector<OFString> values; // first value, what generators and masks get
+	std::vector<OFString> whole; // all values, to tell if a new value is any different
+	std::vector<bool> found, present;
+	std::vector<std::tuple<DcmTagKey, boost::optional<std::string>, size_t>> edits; // new values (none to delete) and their source
+};
+thread_local Scratch scratch;
+}
 
 std::string TagProcessingGenerator::generate(DcmDataset &dset) const
 {
 	OFString original;
-	if(!dset.findAndGetOFString(tag,original).good())
-		return "";
-	if(regex) {
-		std::cmatch what;
-		if (!std::regex_match(original.begin(), original.end(), what, *regex))
-			return "";
-		return what.format(replacement);
-	} else
+	return generate(dset.findAndGetOFString(tag,original).good() ? &original : nullptr);
+}
+
+std::string TagProcessingGenerator::generate(const OFString *original) const
+{
+	if(!regex) // a plain value, it doesn't depend on any tag
 		return replacement;
+	Matcher::Captures what;
+	if(!original || !regex->match(original->c_str(), original->c_str()+original->length(), &what))
+		return "";
+	return Matcher::format(replacement, what);
+}
+
+void TagProcessorList::compile()
+{
+	sources.clear();
+	plan.clear();
+	for(const auto &proc : *this){
+		sources.push_back(proc.tag);
+		for(const auto &generator:proc.generators)
+			sources.push_back(generator.tag);
+	}
+	std::sort(sources.begin(), sources.end());
+	sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+
+	const auto sourceOf=[this](const DcmTagKey &tag){
+		return size_t(std::lower_bound(sources.begin(), sources.end(), tag) - sources.begin());
+	};
+	for(const auto &proc : *this){
+		PlannedProcessor planned{&proc, sourceOf(proc.tag), {}};
+		for(const auto &generator:proc.generators)
+			planned.generator_sources.push_back(sourceOf(generator.tag));
+		plan.push_back(std::move(planned));
+	}
+	// all rules see the dataset as it was given, so a rule reading a tag another one changes gets the value from before
+	for(const auto &proc : *this)
+		for(const auto &generator:proc.generators)
+			for(const auto &other : *this)
+				if(&other!=&proc && other.tag==generator.tag)
+					OrthancPlugins::LogWarning(std::string("The rule for ") + DcmTag(proc.tag).getTagName() + " reads "
+						+ DcmTag(generator.tag).getTagName() + ", which is changed by another rule. It gets the value from before that change");
+	// rules for the same tag stay in the order of the configuration, the last one wins
+	std::stable_sort(plan.begin(), plan.end(), [](const PlannedProcessor &a, const PlannedProcessor &b){
+		return a.processor->tag < b.processor->tag;
+	});
+}
+
+bool TagProcessorList::FixTags(DcmDataset *dset)const
+{
+	Scratch &s=scratch;
+	s.values.resize(sources.size());
+	s.whole.resize(sources.size());
+	s.found.assign(sources.size(), false);
+	s.present.assign(sources.size(), false);
+	s.edits.clear();
+
+	// the top level elements are sorted by tag just like sources, so one walk picks up all of them
+	size_t next=0;
+	for(DcmObject *obj=dset->nextInContainer(nullptr); obj && next<sources.size(); obj=dset->nextInContainer(obj)){
+		const DcmTagKey key=obj->getTag();
+		while(next<sources.size() && sources[next]<key)
+			next++;
+		if(next<sources.size() && sources[next]==key){
+			DcmElement *element=dynamic_cast<DcmElement*>(obj);
+			s.present[next]=element && element->getOFStringArray(s.whole[next]).good();
+			s.found[next]=s.present[next] && element->getOFString(s.values[next],0).good();
+			next++;
+		}
+	}
+
+	static const OFString empty;
+	for(const auto &planned:plan){
+		const TagProcessor &proc=*planned.processor;
+		const OFString &original=s.found[planned.source] ? s.values[planned.source] : empty;
+		if(proc.mask && !proc.mask->match(original.c_str(), original.c_str()+original.length())){
+			continue;//existing mask did not match, don't process this Tag
+		}
+
+		if(proc.generators.empty()){ // is a simple delete
+			s.edits.emplace_back(proc.tag, boost::none, planned.source);
+		} else {
+			std::string replacement;
+			auto source=planned.generator_sources.begin();
+			for (const auto &generator:proc.generators) {
+				replacement+=generator.generate(s.found[*source] ? &s.values[*source] : nullptr);
+				++source;
+			}
+			s.edits.emplace_back(proc.tag, std::move(replacement), planned.source);
+		}
+	}
+
+	// only what really changes the dataset counts, e.g. deleting a tag that isn't there or setting the value it has doesn't
+	bool changed=false, deleted=false;
+	for(auto edit=s.edits.begin(); edit!=s.edits.end(); ++edit){
+		const DcmTagKey &tag=std::get<0>(*edit);
+		const boost::optional<std::string> &value=std::get<1>(*edit);
+		const size_t source=std::get<2>(*edit);
+		if(edit==s.edits.begin() || std::get<0>(*std::prev(edit))!=tag)
+			deleted=false; // edits of a tag follow each other, so that's whether an earlier rule deleted this one
+		if(!value){
+			changed|=dset->findAndDeleteElement(tag,true,true).good();
+			deleted=true;
+		} else if(std::next(edit)!=s.edits.end() && std::get<0>(*std::next(edit))==tag)
+			continue; // a later rule sets the same tag, only the last value is written
+		else if(!deleted && s.present[source] && s.whole[source]==value->c_str())
+			continue;
+		else if(dset->putAndInsertOFStringArray(tag,value->c_str()).good())
+			changed=true;
+		else
+			OrthancPlugins::LogError(std::string("Failed set ") + DcmTag(tag).getTagName() + " to " + *value);
+	}
+	return changed;
 }
 
-TagProcessorList::TagProcessorList(const OrthancPlugins::OrthancConfiguration &configuration)
+TagProcessorList::TagProcessorList(const Json::Value &cfg)
 {
 
 	static const DcmDataDictionary dict(true,true);
@@ -28,7 +144,6 @@ TagProcessorList::TagProcessorList(const OrthancPlugins::OrthancConfiguration &c
 		return;
 	}
 
-	const Json::Value &cfg=configuration.GetJson();
 	clear();
 
 	for(const auto &tag_name:cfg.getMemberNames()) {
@@ -75,9 +190,7 @@ TagProcessorList::TagProcessorList(const OrthancPlugins::OrthancConfiguration &c
 							}
 							case 2: {
 								replacer.removeIndex(0, &buffer);
-								generator.regex = std::regex(buffer.asString(),
-															 std::regex_constants::ECMAScript
-																 | std::regex_constants::optimize);
+								generator.regex = Matcher(buffer.asString());
 							}
 							case 1: {
 								replacer.removeIndex(0, &buffer);
@@ -99,10 +212,10 @@ TagProcessorList::TagProcessorList(const OrthancPlugins::OrthancConfiguration &c
 					continue;
 			}
 			if (cfg[tag_name].isMember("mask")) {
-				processor.mask = std::regex(cfg[tag_name]["mask"].asString(),
-											std::regex_constants::ECMAScript | std::regex_constants::optimize);
+				processor.mask = Matcher(cfg[tag_name]["mask"].asString());
 			}
 			push_back(std::move(processor));
 		}
 	}
+	compile();
 }
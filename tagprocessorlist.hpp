@@ -14,47 +14,52 @@
 #include <boost/optional.hpp>
 #include <boost/filesystem.hpp>
 #include <json/json.h>
-#include <regex>
+#include "matcher.hpp"
 #include <list>
+#include <vector>
 
 struct TagProcessingGenerator {
 	DcmTagKey tag;
-	boost::optional<std::regex> regex;
+	boost::optional<Matcher> regex;
 	std::string replacement;
 	std::string generate(DcmDataset& dset)const;
+	/// same as above with the value of tag already looked up, nullptr if it wasn't found (plain values don't need it)
+	std::string generate(const OFString *original)const;
 };
 struct TagProcessor{
 	DcmTagKey tag;
-	boost::optional<std::regex> mask;
+	boost::optional<Matcher> mask;
 	std::list<TagProcessingGenerator> generators;
 };
 
+/**
+ * The tag processing rules from the configuration, compiled into a plan when they are read.
+ * The plan lists every tag any rule reads (sorted), so FixTags can fetch them all in one walk over the dataset. Then
+ * all rules are evaluated against those values and their edits are applied together, ordered by target tag.
+ * So all rules see the dataset as it was given, not as changed by other rules.
+ */
 class TagProcessorList: public std::list<TagProcessor>
 {
-public:
-	TagProcessorList(const OrthancPlugins::OrthancConfiguration &configuration);
-	void FixTags(DcmDataset *dset)
-	{
-		for(const auto &proc : *this){
-			OFString original;
-			auto erg=dset->findAndGetOFString(proc.tag,original);
-			if(proc.mask && !std::regex_match(original.begin(), original.end(), *proc.mask)){
-				continue;//existing mask did not match, don't process this Tag
-			}
-
-			if(proc.generators.empty()){ // is a simple delete
-				dset->findAndDeleteElement(proc.tag,true,true);
-			} else {
-				std::string replacement;
-				for (const auto &generator:proc.generators) {
-					replacement+=generator.generate(*dset);
-				}
-				if(!dset->putAndInsertOFStringArray(proc.tag,replacement.c_str()).good())
-					OrthancPlugins::LogError(std::string("Failed set ") + DcmTag(proc.tag).getTagName() + " to " + replacement);
-			}
-		}
-	}
+	struct PlannedProcessor{
+		const TagProcessor *processor;
+		size_t source; // index of processor->tag in sources
+		std::vector<size_t> generator_sources; // index of each generator's tag in sources
+	};
+	std::vector<DcmTagKey> sources;
+	std::vector<PlannedProcessor> plan;
 
+	void compile();
+public:
+	/// cfg is the "ProcessTags" section
+	explicit TagProcessorList(const Json::Value &cfg);
+	TagProcessorList(const OrthancPlugins::OrthancConfiguration &configuration):TagProcessorList(configuration.GetJson()){}
+	TagProcessorList(const TagProcessorList &) = delete; // the plan points into the list
+	TagProcessorList &operator=(const TagProcessorList &) = delete;
+	/// returns true if dset was changed (a tag that was there deleted or set to another value), rules that applied
+	/// without changing anything don't count
+	bool FixTags(DcmDataset *dset)const;
+	/// true if any rule changes PixelData or what comes after it (so the file can't be parsed header only)
+	bool touchesPixelData()const{return !plan.empty() && !(plan.back().processor->tag < DcmTagKey(0x7fe0, 0x0010));}
 };
 
 
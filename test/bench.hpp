@@ -0,0 +1,25 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <chrono>
+#include <string>
+#include <iostream>
+
+/// calls fn for about a second and prints the average time a call took
+template<class F> double bench(const std::string &name, F fn)
+{
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	Clock::time_point now;
+	size_t runs = 0;
+	do{
+		fn();
+		runs++;
+		now = Clock::now();
+	}while(now - start < std::chrono::seconds(1));
+	const double us = std::chrono::duration<double, std::micro>(now - start).count() / runs;
+	std::cout << name << ": " << us << " µs per call (" << runs << " calls)" << std::endl;
+	return us;
+}
+
+#endif //BENCH_HPP
@@ -0,0 +1,20 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+
+/*
+ * Minimal helpers for the test executables: CHECK reports failed conditions and counts them, main returns
+ * failures (so ctest sees a non zero exit code) or SkipTest if the test can't run here.
+ */
+extern int failures;
+const int SkipTest = 77;
+
+#define CHECK(condition) do{ \
+	if(!(condition)){ \
+		std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+		failures++; \
+	} \
+}while(0)
+
+#endif //CHECK_HPP
@@ -0,0 +1,85 @@
+#include "bench.hpp"
+#include "../compression.hpp"
+#include "../fileio.hpp"
+#include <boost/filesystem.hpp>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace {
+/// something like the "DicomAsJson" attachment the core stores for an instance with tags tags
+std::string instanceJson(size_t tags)
+{
+	static const char *const names[] = {"PatientName", "StudyDescription", "SeriesDescription", "ImageType", "Manufacturer",
+		"ReferencedSOPInstanceUID", "AcquisitionDate", "SliceThickness", "ImagePositionPatient", "WindowCenter"};
+	std::string json = "{\n";
+	for(size_t i = 0; i < tags; i++){
+		char tag[32];
+		snprintf(tag, sizeof(tag), "%04zx,%04zx", 0x0008 + i / 64 * 2, i % 64 * 16);
+		json += std::string("\t\"") + tag + "\" : {\n\t\t\"Name\" : \"" + names[i % 10] + "\",\n\t\t\"Type\" : \"String\",\n"
+			+ "\t\t\"Value\" : \"1.2.826.0.1.3680043.2.1143." + std::to_string(i * 7919 % 100003) + "\"\n\t}" + (i + 1 < tags ? ",\n" : "\n");
+	}
+	return json + "}\n";
+}
+
+void store(const fs::path &path, const void *data, size_t size)
+{
+	FileDescriptor file(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, DEFFILEMODE);
+	pwriteAll(file, data, size, 0);
+}
+
+/// what the read callbacks do for a file that may be compressed: all of it, or count bytes at offset
+void readWhole(const fs::path &path, std::vector<char> &target)
+{
+	FileDescriptor file(path.c_str(), O_RDONLY);
+	uint64_t size;
+	if(isCompressed(file, size)){
+		target.resize(size);
+		inflateRange(file, target.data(), size);
+	} else {
+		struct stat st;
+		fstat(file, &st);
+		target.resize(st.st_size);
+		preadAll(file, target.data(), target.size(), 0);
+	}
+}
+void readRange(const fs::path &path, std::vector<char> &target, uint64_t offset)
+{
+	FileDescriptor file(path.c_str(), O_RDONLY);
+	uint64_t size;
+	if(isCompressed(file, size))
+		inflateRange(file, target.data(), target.size(), offset);
+	else
+		preadAll(file, target.data(), target.size(), offset);
+}
+}
+
+/// compares size and read latency (whole file and a range in the middle, from the page cache) of plain and compressed JSON attachments
+int main()
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path("compression-%%%%-%%%%");
+	fs::create_directories(dir);
+	for(size_t tags:{100, 1000, 10000}){
+		const std::string json = instanceJson(tags);
+		const std::string size = std::to_string(json.size() / 1024) + " kB";
+		store(dir / "plain", json.data(), json.size());
+		std::vector<char> buffer, range(4096);
+		const double plain = bench(size + " plain whole", [&]{readWhole(dir / "plain", buffer);});
+		const double plain_range = bench(size + " plain range", [&]{readRange(dir / "plain", range, json.size() / 2);});
+		for(int level:{1, 3, 9}){
+			std::vector<char> compressed;
+			if(!compressContent(json.data(), json.size(), compressed, level))
+				continue;
+			store(dir / "compressed", compressed.data(), compressed.size());
+			const std::string name = size + " level " + std::to_string(level);
+			const double whole = bench(name + " whole", [&]{readWhole(dir / "compressed", buffer);});
+			const double part = bench(name + " range", [&]{readRange(dir / "compressed", range, json.size() / 2);});
+			std::cout << "ratio " << double(json.size()) / compressed.size() << ", slowdown whole " << whole / plain
+				<< ", range " << part / plain_range << std::endl;
+		}
+	}
+	fs::remove_all(dir);
+	return 0;
+}
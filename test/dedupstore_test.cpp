@@ -0,0 +1,91 @@
+#include "check.hpp"
+#include "../dedupstore.hpp"
+#include "../shadowtree.hpp"
+#include "../xxhash.hpp"
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace {
+const std::string content = "the same content in two attachments";
+const std::string first = "0123abcd-0000-0000-0000-000000000001", second = "0123abcd-0000-0000-0000-000000000002";
+
+nlink_t links(const fs::path &file)
+{
+	struct stat st;
+	return stat(file.c_str(), &st) ? 0 : st.st_nlink;
+}
+
+/// two attachments sharing one blob, returns false if the filesystem can't do that (no user xattrs)
+bool setup(DedupStore &dedup, const fs::path &root, fs::path &a, fs::path &b)
+{
+	a = GetOPath(first, root);
+	b = GetOPath(second, root);
+	fs::create_directories(a.parent_path());
+	std::ofstream(a.native()) << content;
+	if(setxattr(a.c_str(), "user.test", "", 0, 0))
+		return false;
+	const uint64_t hash = XXH64::hash(content.data(), content.size());
+	dedup.add(hash, first, a);
+	CHECK(dedup.link(hash, content.data(), content.size(), second, b));
+	CHECK(links(a) == 3); // a, b and the blob
+	return true;
+}
+
+/// a symlink shadow (see createShadow) is not a link of the file, so the content is still used by the second attachment
+int symlinkShadow(const fs::path &root)
+{
+	DedupStore dedup(root);
+	fs::path a, b;
+	if(!setup(dedup, root, a, b))
+		return SkipTest;
+	const fs::path shadow = root / "shadow";
+	CHECK(symlink(a.c_str(), shadow.c_str()) == 0);
+
+	CHECK(dedup.release(a, shadow)); // b still uses it, so a is gone and the shadow has to stay
+	CHECK(!fs::exists(a));
+	CHECK(fs::exists(b));
+	CHECK(links(b) == 2); // b and the blob
+	CHECK(!dedup.release(b, shadow)); // last one, the blob is dropped and b is left to the caller
+	CHECK(links(b) == 1);
+	return 0;
+}
+
+int hardlinkShadow(const fs::path &root)
+{
+	DedupStore dedup(root);
+	fs::path a, b;
+	if(!setup(dedup, root, a, b))
+		return SkipTest;
+	const fs::path shadow = root / "shadow";
+	CHECK(link(a.c_str(), shadow.c_str()) == 0);
+
+	CHECK(dedup.release(a, shadow));
+	CHECK(!fs::exists(a));
+	CHECK(links(b) == 3); // b, the blob and the shadow
+	CHECK(!dedup.release(b, shadow));
+	CHECK(links(b) == 2);
+	return 0;
+}
+
+int inTemporaryDirectory(int (*test)(const fs::path &))
+{
+	const fs::path root = fs::temp_directory_path() / fs::unique_path("dedupstore-%%%%-%%%%");
+	fs::create_directories(root);
+	const int ret = test(root);
+	fs::remove_all(root);
+	return ret;
+}
+}
+
+int main()
+{
+	if(inTemporaryDirectory(symlinkShadow) == SkipTest || inTemporaryDirectory(hardlinkShadow) == SkipTest){
+		std::cerr << "The temporary directory doesn't support user extended attributes" << std::endl;
+		return SkipTest;
+	}
+	return failures;
+}
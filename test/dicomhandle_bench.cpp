@@ -0,0 +1,31 @@
+#include "bench.hpp"
+#include "dicomsamples.hpp"
+#include "../dicomhandle.hpp"
+#include <dcmtk/dcmdata/dcdeftag.h>
+
+namespace {
+/// what the received-instance callback does: parse, change a header value, write
+void rewrite(const std::vector<char> &input, bool header_only)
+{
+	DicomHandle handle(input.data(), input.size(), header_only);
+	handle.replaceString(DCM_PatientName, "Somebody^Else");
+	OrthancPluginMemoryBuffer64 output;
+	if(handle.SaveToMemoryBuffer(&output))
+		free(output.data);
+}
+}
+
+/// compares rewriting instances of different sizes with the whole file parsed and with only the header
+int main()
+{
+	for(unsigned short side:{64, 512, 2048}){
+		SampleOptions options;
+		options.rows = options.columns = side;
+		const std::vector<char> input = makeSample(options);
+		const std::string size = std::to_string(input.size() / 1024) + " kB";
+		const double full = bench(size + " whole file", [&input]{rewrite(input, false);});
+		const double header = bench(size + " header only", [&input]{rewrite(input, true);});
+		std::cout << "speedup " << full / header << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+#include "check.hpp"
+#include "dicomsamples.hpp"
+#include "../dicomhandle.hpp"
+#include "../dicomscanner.hpp"
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <cstring>
+
+namespace {
+/// where PixelData (or what follows the header) starts in an encoded file
+size_t tailOffset(const void *data, size_t size)
+{
+	DicomScanner scanner({DicomScanner::PixelData - 1});
+	return scanner.scan(data, size) ? scanner.stopOffset() : size;
+}
+
+/// reads all of the file, like the core would
+bool readFully(const void *data, size_t size, OFString &patient_name)
+{
+	DcmFileFormat file;
+	DcmInputBufferStream is;
+	is.setBuffer(data, size);
+	is.setEos();
+	file.transferInit();
+	const OFCondition read = file.read(is);
+	file.transferEnd();
+	return read.good() && file.getDataset()->findAndGetOFString(DCM_PatientName, patient_name).good();
+}
+
+template<class Buffer> void roundTrip(const char *name, const std::vector<char> &input)
+{
+	std::cerr << name << std::endl;
+	CHECK(!input.empty());
+	const size_t tail = tailOffset(input.data(), input.size());
+	CHECK(tail < input.size());
+
+	DicomHandle handle(input.data(), input.size(), true);
+	CHECK(handle.valid);
+	CHECK(handle.headerOnly());
+	// a longer name moves the tail in the written file
+	const std::string replacement = "Somebody^With^A^Much^Longer^Name";
+	CHECK(handle.replaceString(DCM_PatientName, replacement));
+
+	Buffer output;
+	if(!handle.SaveToMemoryBuffer(&output)){
+		std::cerr << "SaveToMemoryBuffer failed" << std::endl;
+		failures++;
+		return;
+	}
+	const size_t written_tail = tailOffset(output.data, output.size);
+	CHECK(output.size - written_tail == input.size() - tail);
+	CHECK(memcmp(static_cast<const char *>(output.data) + written_tail, input.data() + tail, input.size() - tail) == 0);
+
+	OFString patient_name;
+	CHECK(readFully(output.data, output.size, patient_name));
+	CHECK(patient_name == replacement.c_str());
+	free(output.data);
+}
+
+void roundTrip(const char *name, const SampleOptions &options)
+{
+	const std::vector<char> input = makeSample(options);
+	roundTrip<OrthancPluginMemoryBuffer64>(name, input);
+	roundTrip<OrthancPluginMemoryBuffer>(name, input);
+}
+}
+
+/*
+ * DicomHandle in header_only mode writes the changed header and copies the rest of the file as it was, so the tail of
+ * what it writes has to be byte for byte the tail of what it read, in every encoding.
+ */
+int main()
+{
+	SampleOptions options;
+	options.xfer = EXS_LittleEndianImplicit;
+	roundTrip("implicit VR little endian", options);
+	options.xfer = EXS_LittleEndianExplicit;
+	roundTrip("explicit VR little endian", options);
+	options.xfer = EXS_BigEndianExplicit;
+	roundTrip("explicit VR big endian", options);
+	options.xfer = EXS_JPEGProcess1;
+	roundTrip("encapsulated PixelData of undefined length", options);
+
+	options.xfer = EXS_LittleEndianExplicit;
+	options.group_length = true;
+	roundTrip("with (7FE0,0000)", options);
+	options.group_length = false;
+	options.padding = 256;
+	roundTrip("with (FFFC,FFFC) padding", options);
+	options.xfer = EXS_LittleEndianImplicit;
+	options.group_length = true;
+	roundTrip("implicit VR with group lengths and padding", options);
+	return failures;
+}
@@ -0,0 +1,75 @@
+#include "dicomsamples.hpp"
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcostrmb.h>
+#include <dcmtk/dcmdata/dcpixel.h>
+#include <dcmtk/dcmdata/dcpixseq.h>
+#include <dcmtk/dcmdata/dcpxitem.h>
+#include <dcmtk/dcmdata/dcuid.h>
+
+std::vector<char> makeSample(const SampleOptions &options)
+{
+	DcmFileFormat file;
+	DcmDataset *dataset = file.getDataset();
+	dataset->putAndInsertString(DCM_SOPClassUID, UID_SecondaryCaptureImageStorage);
+	dataset->putAndInsertString(DCM_SOPInstanceUID, "1.2.826.0.1.3680043.2.1143.1.1.1");
+	dataset->putAndInsertString(DCM_StudyInstanceUID, "1.2.826.0.1.3680043.2.1143.1");
+	dataset->putAndInsertString(DCM_SeriesInstanceUID, "1.2.826.0.1.3680043.2.1143.1.1");
+	dataset->putAndInsertString(DCM_PatientName, options.patient_name.c_str());
+	dataset->putAndInsertString(DCM_PatientID, options.patient_id.c_str());
+	dataset->putAndInsertString(DCM_StudyDate, "20210318");
+	dataset->putAndInsertString(DCM_StudyTime, "120000");
+	dataset->putAndInsertString(DCM_SeriesNumber, "1");
+	dataset->putAndInsertString(DCM_SeriesDescription, "sample");
+	dataset->putAndInsertString(DCM_Modality, "OT");
+
+	// a sequence, so the header has nested lengths that change when it's written again
+	DcmItem *item;
+	if(dataset->findOrCreateSequenceItem(DCM_ReferencedImageSequence, item, -2).good())
+		item->putAndInsertString(DCM_ReferencedSOPInstanceUID, "1.2.826.0.1.3680043.2.1143.1.1.2");
+
+	const bool encapsulated = DcmXfer(options.xfer).isEncapsulated();
+	dataset->putAndInsertUint16(DCM_Rows, options.rows);
+	dataset->putAndInsertUint16(DCM_Columns, options.columns);
+	dataset->putAndInsertUint16(DCM_SamplesPerPixel, 1);
+	dataset->putAndInsertString(DCM_PhotometricInterpretation, "MONOCHROME2");
+	dataset->putAndInsertUint16(DCM_BitsAllocated, encapsulated ? 8 : 16);
+	dataset->putAndInsertUint16(DCM_BitsStored, encapsulated ? 8 : 12);
+	dataset->putAndInsertUint16(DCM_HighBit, encapsulated ? 7 : 11);
+	dataset->putAndInsertUint16(DCM_PixelRepresentation, 0);
+
+	const size_t count = size_t(options.rows) * options.columns;
+	if(encapsulated){
+		// never decoded, so it doesn't have to be a valid JPEG
+		DcmPixelSequence *sequence = new DcmPixelSequence(DCM_PixelSequenceTag);
+		sequence->insert(new DcmPixelItem(DCM_PixelItemTag)); // empty offset table
+		for(size_t f = 0; f < 3; f++){
+			std::vector<Uint8> bytes(count / 3 & ~size_t(1));
+			for(size_t i = 0; i < bytes.size(); i++)
+				bytes[i] = Uint8(i * 7 + f);
+			DcmPixelItem *fragment = new DcmPixelItem(DCM_PixelItemTag);
+			fragment->putUint8Array(bytes.data(), bytes.size());
+			sequence->insert(fragment);
+		}
+		DcmPixelData *pixels = new DcmPixelData(DCM_PixelData);
+		pixels->putOriginalRepresentation(options.xfer, nullptr, sequence);
+		dataset->insert(pixels);
+	} else {
+		std::vector<Uint16> pixels(count);
+		for(size_t i = 0; i < count; i++)
+			pixels[i] = Uint16(i * 7 & 0xfff);
+		dataset->putAndInsertUint16Array(DCM_PixelData, pixels.data(), pixels.size());
+	}
+
+	std::vector<char> buffer(file.calcElementLength(options.xfer, EET_UndefinedLength) + options.padding + 4096);
+	DcmOutputBufferStream out(buffer.data(), buffer.size());
+	file.transferInit();
+	const OFCondition written = file.write(
+		out, options.xfer, EET_UndefinedLength, nullptr,
+		options.group_length ? EGL_withGL : EGL_withoutGL,
+		options.padding ? EPD_withPadding : EPD_withoutPadding, options.padding, 0);
+	file.transferEnd();
+	out.flush();
+	buffer.resize(written.good() ? size_t(out.tell()) : 0);
+	return buffer;
+}
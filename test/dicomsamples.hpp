@@ -0,0 +1,21 @@
+#ifndef DICOMSAMPLES_HPP
+#define DICOMSAMPLES_HPP
+
+#include <dcmtk/dcmdata/dcxfer.h>
+#include <string>
+#include <vector>
+
+/// what makeSample puts into the file and how it's encoded
+struct SampleOptions
+{
+	E_TransferSyntax xfer = EXS_LittleEndianExplicit; // encapsulated ones get (made up) fragments as PixelData
+	bool group_length = false; // write group lengths, including (7FE0,0000)
+	unsigned padding = 0; // pad the dataset to a multiple of that with (FFFC,FFFC)
+	std::string patient_name = "Doe^John", patient_id = "12345";
+	unsigned short rows = 64, columns = 64;
+};
+
+/// a complete DICOM file (secondary capture) encoded in memory, empty if DCMTK failed to write it
+std::vector<char> makeSample(const SampleOptions &options);
+
+#endif //DICOMSAMPLES_HPP
@@ -0,0 +1,70 @@
+#include "check.hpp"
+#include "dicomsamples.hpp"
+#include "../dicomscanner.hpp"
+#include "../shadowtree.hpp"
+
+namespace {
+typedef DicomScanner S;
+
+void scan(const char *name, const SampleOptions &options)
+{
+	std::cerr << name << std::endl;
+	const std::vector<char> file = makeSample(options);
+	CHECK(!file.empty());
+
+	S scanner({S::makeTag(0x0008, 0x0018), S::makeTag(0x0008, 0x103e), S::makeTag(0x0010, 0x0010),
+		S::makeTag(0x0010, 0x0020), S::makeTag(0x0020, 0x0011)});
+	CHECK(scanner.scan(file.data(), file.size()));
+	CHECK(scanner.get(S::makeTag(0x0008, 0x0018)) == "1.2.826.0.1.3680043.2.1143.1.1.1");
+	CHECK(scanner.get(S::makeTag(0x0008, 0x103e)) == "sample");
+	CHECK(scanner.get(S::makeTag(0x0010, 0x0010)) == options.patient_name);
+	CHECK(scanner.get(S::makeTag(0x0010, 0x0020)) == options.patient_id);
+	CHECK(scanner.get(S::makeTag(0x0020, 0x0011)) == "1");
+	CHECK(scanner.get(S::makeTag(0x0020, 0x0013)).empty()); // not asked for
+	// nothing after the last wanted tag is looked at
+	CHECK(scanner.isDeflated() || scanner.stopOffset() < file.size() / 2);
+
+	// the shadow is named the same as by a full parse
+	const boost::filesystem::path scanned = ScanSPath(file.data(), file.size());
+	CHECK(!scanned.empty());
+	CHECK(scanned == GetSPathFull(file.data(), file.size()));
+	CHECK(GetSPath(file.data(), file.size()) == scanned);
+
+	// the beginning of the file is enough (deflated files are inflated as far as they go)
+	if(!scanner.isDeflated()){
+		const size_t header = scanner.stopOffset() + 12; // and the header of the element it stopped at
+		CHECK(ScanSPath(file.data(), header, true) == scanned);
+		CHECK(ScanSPath(file.data(), 200, true).empty()); // but only if it has all of the header
+	}
+	// a cut off file is not taken for a complete one
+	CHECK(!scanner.scan(file.data(), 200) || scanner.get(S::makeTag(0x0020, 0x0011)).empty());
+}
+}
+
+/// DicomScanner on all transfer syntaxes it supports, compared with what DCMTK reads
+int main()
+{
+	SampleOptions options;
+	options.xfer = EXS_LittleEndianImplicit;
+	scan("implicit little endian", options);
+	options.xfer = EXS_LittleEndianExplicit;
+	scan("explicit little endian", options);
+	options.xfer = EXS_BigEndianExplicit;
+	scan("explicit big endian", options);
+	options.xfer = EXS_DeflatedLittleEndianExplicit;
+	scan("deflated explicit little endian", options);
+	options.xfer = EXS_JPEGProcess1;
+	scan("encapsulated", options);
+	options.xfer = EXS_LittleEndianExplicit;
+	options.group_length = true;
+	scan("with group lengths", options);
+	options.group_length = false;
+	options.patient_name = "Doe^Jo"; // padded to an even length
+	options.patient_id = "";
+	scan("padded and empty values", options);
+
+	S scanner({S::makeTag(0x0010, 0x0010)});
+	const std::string garbage(1024, 'x');
+	CHECK(!scanner.scan(garbage.data(), garbage.size())); // no preamble, DCMTK has to deal with it
+	return failures;
+}
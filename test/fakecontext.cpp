@@ -0,0 +1,30 @@
+#include "OrthancPluginCppWrapper.h"
+#include <cstdlib>
+
+// just enough of an Orthanc core for the memory buffers the code under test creates and frees
+namespace {
+OrthancPluginErrorCode invokeService(OrthancPluginContext *, _OrthancPluginService service, const void *params)
+{
+	switch(service){
+	case _OrthancPluginService_CreateMemoryBuffer:{
+		const _OrthancPluginCreateMemoryBuffer &p = *static_cast<const _OrthancPluginCreateMemoryBuffer *>(params);
+		p.target->data = malloc(p.size);
+		p.target->size = p.size;
+		return p.target->data || !p.size ? OrthancPluginErrorCode_Success : OrthancPluginErrorCode_NotEnoughMemory;
+	}
+	case _OrthancPluginService_CreateMemoryBuffer64:{
+		const _OrthancPluginCreateMemoryBuffer64 &p = *static_cast<const _OrthancPluginCreateMemoryBuffer64 *>(params);
+		p.target->data = malloc(p.size);
+		p.target->size = p.size;
+		return p.target->data || !p.size ? OrthancPluginErrorCode_Success : OrthancPluginErrorCode_NotEnoughMemory;
+	}
+	default:
+		return OrthancPluginErrorCode_NotImplemented;
+	}
+}
+OrthancPluginContext context = {nullptr, "mainline", free, invokeService};
+}
+
+namespace OrthancPlugins{
+OrthancPluginContext *GetGlobalContext(){return &context;}
+}
@@ -0,0 +1,24 @@
+#include "bench.hpp"
+#include "dicomsamples.hpp"
+#include "../shadowtree.hpp"
+
+/// compares naming the shadow of instances of different sizes and encodings from the scanned header and with DCMTK
+int main()
+{
+	const std::pair<const char *, E_TransferSyntax> syntaxes[] = {
+		{"explicit little endian", EXS_LittleEndianExplicit}, {"implicit little endian", EXS_LittleEndianImplicit},
+		{"explicit big endian", EXS_BigEndianExplicit}, {"deflated", EXS_DeflatedLittleEndianExplicit}
+	};
+	for(const auto &syntax:syntaxes)
+		for(unsigned short side:{64, 512, 2048}){
+			SampleOptions options;
+			options.xfer = syntax.second;
+			options.rows = options.columns = side;
+			const std::vector<char> input = makeSample(options);
+			const std::string name = std::string(syntax.first) + " " + std::to_string(input.size() / 1024) + " kB";
+			const double full = bench(name + " DCMTK", [&input]{GetSPathFull(input.data(), input.size());});
+			const double scanned = bench(name + " scanner", [&input]{ScanSPath(input.data(), input.size());});
+			std::cout << "speedup " << full / scanned << std::endl;
+		}
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include "bench.hpp"
+#include "dicomsamples.hpp"
+#include "../dicomhandle.hpp"
+#include "../fileio.hpp"
+#include "../tagprocessorlist.hpp"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = boost::filesystem;
+
+namespace {
+/// a typical anonymisation, like our "ProcessTags"
+const char *const Rules = R"json({
+	"PatientBirthDate" : {"delete" : true},
+	"PatientAddress" : {"delete" : true},
+	"PatientTelephoneNumbers" : {"delete" : true},
+	"OtherPatientIDs" : {"delete" : true},
+	"OtherPatientNames" : {"delete" : true},
+	"InstitutionName" : {"replace" : ["Anonymous"]},
+	"InstitutionAddress" : {"delete" : true},
+	"ReferringPhysicianName" : {"replace" : [""]},
+	"PerformingPhysicianName" : {"delete" : true},
+	"OperatorsName" : {"delete" : true},
+	"StationName" : {"delete" : true},
+	"StudyDescription" : {"replace" : [["StudyDescription", "([^^]*)\\^(.*)", "$2"]]},
+	"SeriesDescription" : {"mask" : ".*localizer.*", "replace" : ["localizer"]}
+})json";
+
+void store(const fs::path &path, const void *data, size_t size)
+{
+	FileDescriptor file(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, DEFFILEMODE);
+	pwriteAll(file, data, size, 0);
+}
+std::vector<char> load(const fs::path &path)
+{
+	FileDescriptor file(path.c_str(), O_RDONLY);
+	std::vector<char> data(lseek(file, 0, SEEK_END));
+	preadAll(file, data.data(), data.size(), 0);
+	return data;
+}
+/// what is done to an instance before it is stored, the patient mapping is just a replaced PatientName here
+bool process(const std::vector<char> &input, const TagProcessorList &rules, bool header_only, OrthancPluginMemoryBuffer64 &output)
+{
+	DicomHandle handle(input.data(), input.size(), header_only);
+	handle.replaceString(DCM_PatientName, "Mapped^Name");
+	rules.FixTags(handle.getDataset());
+	return handle.SaveToMemoryBuffer(&output);
+}
+}
+
+/*
+ * Compares the cost per instance of rewriting at ingest (received-instance callback: header only parse, rules, one
+ * write) and of the earlier store-then-modify (the instance is stored, read back, parsed completely, rewritten and
+ * stored again while the first copy is removed). Orthanc's own work (database, REST) comes on top of both.
+ */
+int main()
+{
+	std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+	Json::Value cfg;
+	std::string errors;
+	reader->parse(Rules, Rules + strlen(Rules), &cfg, &errors);
+	const TagProcessorList rules(cfg);
+
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path("ingest-%%%%-%%%%");
+	fs::create_directories(dir);
+	for(unsigned short side:{256, 512, 1024}){
+		SampleOptions options;
+		options.rows = options.columns = side;
+		const std::vector<char> input = makeSample(options);
+		const std::string size = std::to_string(input.size() / 1024) + " kB";
+
+		const double before = bench(size + " store then modify", [&]{
+			store(dir / "original", input.data(), input.size());
+			OrthancPluginMemoryBuffer64 output;
+			if(process(load(dir / "original"), rules, false, output)){
+				store(dir / "modified", output.data, output.size);
+				free(output.data);
+			}
+			unlink((dir / "original").c_str());
+		});
+		const double now = bench(size + " rewrite at ingest", [&]{
+			OrthancPluginMemoryBuffer64 output;
+			if(process(input, rules, true, output)){
+				store(dir / "modified", output.data, output.size);
+				free(output.data);
+			}
+		});
+		std::cout << "instances/s " << 1e6 / before << " -> " << 1e6 / now << std::endl;
+	}
+	fs::remove_all(dir);
+	return 0;
+}
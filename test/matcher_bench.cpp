@@ -0,0 +1,43 @@
+#include "bench.hpp"
+#include "../matcher.hpp"
+
+namespace {
+struct Case{
+	const char *name, *pattern;
+	std::vector<std::string> texts; // matching and not
+};
+}
+
+/// compares Matcher with std::regex_match on patterns like the ones in our configuration, with captures where they have groups
+int main()
+{
+	const std::vector<Case> cases = {
+		{"subject ID", "([0-9]{5})\\.([0-9a-fA-F]{2}).*", {"12345.ab", "12345.AB-followup", "Doe^John", "1234.ab"}},
+		{"name mapping", "([^^]*)\\^([^^]*)(\\^.*)?", {"Doe^John", "Doe^John^Middle", "Anonymous", "Mustermann^Erika^^Dr."}},
+		{"name prefix", "Study.*", {"Study^2021^Followup", "Patient^Study"}},
+		{"LocalIpRegex literal", "127.0.0.1", {"127.0.0.1", "10.0.0.1"}},
+		{"LocalIpRegex prefix", "192\\.168\\..*", {"192.168.1.20", "172.16.0.1"}},
+		{"LocalIpRegex ranges", "(127\\.0\\.0\\.1|10\\.[0-9]+\\.[0-9]+\\.[0-9]+|192\\.168\\.[0-9]+\\.[0-9]+)", {"10.1.2.3", "192.168.1.20", "8.8.8.8"}},
+	};
+	for(const Case &c:cases){
+		const Matcher matcher(c.pattern);
+		const std::regex regex(c.pattern);
+		const bool captures = matcher.groups() > 1;
+		std::cout << c.name << " (" << matcher.kind() << ")" << std::endl;
+		Matcher::Captures mine;
+		std::cmatch theirs;
+		const double ours = bench("  Matcher", [&]{
+			for(const std::string &text:c.texts)
+				matcher.match(text.data(), text.data() + text.size(), captures ? &mine : nullptr);
+		});
+		const double std_regex = bench("  std::regex", [&]{
+			for(const std::string &text:c.texts)
+				if(captures)
+					std::regex_match(text.data(), text.data() + text.size(), theirs, regex);
+				else
+					std::regex_match(text.data(), text.data() + text.size(), regex);
+		});
+		std::cout << "  speedup " << std_regex / ours << std::endl;
+	}
+	return 0;
+}
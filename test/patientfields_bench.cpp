@@ -0,0 +1,52 @@
+#include "bench.hpp"
+#include "dicomsamples.hpp"
+#include "../patientfields.hpp"
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
+#include <jsoncpp/json/writer.h>
+
+namespace {
+/// roughly what the core does for OrthancPluginGetInstanceSimplifiedJson: parse the whole file, turn it into JSON
+std::string simplifiedJson(const std::vector<char> &file)
+{
+	DcmFileFormat format;
+	DcmInputBufferStream is;
+	is.setBuffer(file.data(), file.size());
+	is.setEos();
+	format.transferInit();
+	format.read(is);
+	format.transferEnd();
+	Json::Value root;
+	DcmDataset *dataset = format.getDataset();
+	for(unsigned long i = 0; i < dataset->card(); i++){
+		DcmElement *element = dataset->getElement(i);
+		OFString value;
+		if(element->getTag() != DCM_PixelData && element->getOFStringArray(value).good())
+			root[DcmTag(element->getTag()).getTagName()] = value.c_str();
+	}
+	return Json::writeString(Json::StreamWriterBuilder(), root);
+}
+}
+
+/// compares getting PatientID/PatientName of a received instance with the DicomScanner and through the JSON
+int main()
+{
+	for(unsigned short side:{64, 512, 2048}){
+		SampleOptions options;
+		options.rows = options.columns = side;
+		const std::vector<char> input = makeSample(options);
+		const std::string size = std::to_string(input.size() / 1024) + " kB";
+		const double json = bench(size + " JSON", [&input]{
+			const std::string text = simplifiedJson(input);
+			PatientFields fields;
+			fields.fromJson(text.data(), text.data() + text.size());
+		});
+		const double scanned = bench(size + " scanner", [&input]{
+			PatientFields fields;
+			fields.fromFile(input.data(), input.size());
+		});
+		std::cout << "speedup " << json / scanned << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include "check.hpp"
+#include "dicomsamples.hpp"
+#include "../patientfields.hpp"
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <dcmtk/dcmdata/dcfilefo.h>
+#include <dcmtk/dcmdata/dcistrmb.h>
+#include <jsoncpp/json/writer.h>
+
+namespace {
+/// the simplified JSON the core would give for the instance, with PatientID and PatientName as DCMTK reads them
+std::string coreJson(const std::vector<char> &file)
+{
+	DcmFileFormat format;
+	DcmInputBufferStream is;
+	is.setBuffer(file.data(), file.size());
+	is.setEos();
+	format.transferInit();
+	CHECK(format.read(is).good());
+	format.transferEnd();
+	Json::Value root;
+	OFString value;
+	if(format.getDataset()->findAndGetOFStringArray(DCM_PatientID, value).good())
+		root["PatientID"] = value.c_str();
+	if(format.getDataset()->findAndGetOFStringArray(DCM_PatientName, value).good())
+		root["PatientName"] = value.c_str();
+	return Json::writeString(Json::StreamWriterBuilder(), root);
+}
+/// the same with the values exactly as encoded, padding included
+std::string rawJson(const SampleOptions &options)
+{
+	Json::Value root;
+	root["PatientID"] = options.patient_id + (options.patient_id.size() % 2 ? " " : "");
+	root["PatientName"] = options.patient_name + (options.patient_name.size() % 2 ? " " : "");
+	return Json::writeString(Json::StreamWriterBuilder(), root);
+}
+
+/// the filter checks what PatientFields gives, so both paths have to give the same strings for the same verdict
+void compare(E_TransferSyntax xfer, const std::string &id, const std::string &name, const std::string &first_id, const std::string &first_name)
+{
+	SampleOptions options;
+	options.xfer = xfer;
+	options.patient_id = id;
+	options.patient_name = name;
+	const std::vector<char> file = makeSample(options);
+	CHECK(!file.empty());
+
+	PatientFields scanned;
+	CHECK(scanned.fromFile(file.data(), file.size()));
+	CHECK(scanned.has_id && scanned.id == first_id);
+	CHECK(scanned.has_name && scanned.name == first_name);
+	for(const std::string &json:{coreJson(file), rawJson(options)}){
+		PatientFields parsed;
+		CHECK(parsed.fromJson(json.data(), json.data() + json.size()));
+		CHECK(parsed.has_id == scanned.has_id && parsed.id == scanned.id);
+		CHECK(parsed.has_name == scanned.has_name && parsed.name == scanned.name);
+	}
+}
+}
+
+/// the DicomScanner and the JSON path of the instance filter agree on PatientID and PatientName
+int main()
+{
+	for(E_TransferSyntax xfer:{EXS_LittleEndianImplicit, EXS_LittleEndianExplicit, EXS_BigEndianExplicit}){
+		compare(xfer, "12345.ab", "Doe^John", "12345.ab", "Doe^John");
+		compare(xfer, "12345.abc", "Doe^Jo", "12345.abc", "Doe^Jo"); // odd length, padded with a space
+		compare(xfer, " 12345.ab  ", "  Doe^John ", "12345.ab", "Doe^John");
+		compare(xfer, "12345.ab\\67890.cd", "Doe^John\\Roe^Jane", "12345.ab", "Doe^John");
+		compare(xfer, " 12345.ab \\67890.cd", "Doe^John \\ Roe^Jane", "12345.ab", "Doe^John");
+		compare(xfer, "", "", "", "");
+	}
+	PatientFields none;
+	const std::string empty = "{}";
+	CHECK(none.fromJson(empty.data(), empty.data() + empty.size()) && !none.has_id && !none.has_name);
+	const std::string broken = "{\"PatientID\"";
+	CHECK(!none.fromJson(broken.data(), broken.data() + broken.size()));
+	return failures;
+}
@@ -0,0 +1,59 @@
+#include "check.hpp"
+#include "../published.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+struct Version{
+	enum {Alive = 0x600d, Dead = 0xdead};
+	unsigned state = Alive;
+	size_t number;
+	explicit Version(size_t number):number(number){}
+	~Version(){state = Dead;}
+};
+
+/// readers check that what they got is still alive and never older than what they saw before,
+/// between two reads they yield or, if pause is set, sleep so that hundreds of them don't starve the publisher
+void readWhilePublishing(size_t readers, size_t versions, bool pause)
+{
+	Published<Version> published;
+	published.publish(std::unique_ptr<const Version>(new Version(0)));
+	std::atomic<bool> done{false};
+	std::atomic<size_t> bad{0}, started{0};
+	std::vector<std::thread> threads;
+	for(size_t r = 0; r < readers; r++)
+		threads.emplace_back([&]{
+			started++;
+			size_t last = 0;
+			while(!done){
+				const Published<Version>::Reader version(published);
+				if(version->state != Version::Alive || version->number < last)
+					bad++;
+				last = version->number;
+				if(pause)
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+				else
+					std::this_thread::yield(); // let the others (and the publisher) run on small machines
+			}
+		});
+	while(started < readers)
+		std::this_thread::yield();
+	for(size_t v = 1; v <= versions; v++)
+		published.publish(std::unique_ptr<const Version>(new Version(v)));
+	done = true;
+	for(auto &thread:threads)
+		thread.join();
+	CHECK(bad == 0);
+	const Published<Version>::Reader last(published);
+	CHECK(last->number == versions);
+}
+}
+
+int main()
+{
+	readWhilePublishing(std::max(2u, std::thread::hardware_concurrency()), 20000, false);
+	// more threads than slots, the rest read under the mutex
+	readWhilePublishing(Published<Version>::MaxReaders + 16, 200, true);
+	return failures;
+}
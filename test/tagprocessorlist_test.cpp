@@ -0,0 +1,62 @@
+#include "check.hpp"
+#include "../tagprocessorlist.hpp"
+#include <dcmtk/dcmdata/dcdeftag.h>
+#include <memory>
+
+namespace {
+Json::Value parse(const std::string &text)
+{
+	Json::Value value;
+	std::string errors;
+	std::unique_ptr<Json::CharReader> reader(Json::CharReaderBuilder().newCharReader());
+	reader->parse(text.data(), text.data() + text.size(), &value, &errors);
+	return value;
+}
+}
+
+/// FixTags only reports a change if the dataset really changed, so instances the rules don't affect are kept as they are
+int main()
+{
+	const TagProcessorList rules(parse(R"json({
+		"PatientBirthDate" : {"delete" : true},
+		"PatientSex" : {"replace" : ["O"]},
+		"InstitutionName" : {"replace" : ["Anonymous"]},
+		"StudyDescription" : {"replace" : [["StudyDescription", "(.*)-(.*)", "$2-$1"]]}
+	})json"));
+	CHECK(rules.size() == 4);
+
+	DcmDataset dataset;
+	dataset.putAndInsertString(DCM_PatientSex, "O");
+	dataset.putAndInsertString(DCM_InstitutionName, "Hospital");
+	CHECK(rules.FixTags(&dataset)); // InstitutionName is replaced
+	OFString value;
+	CHECK(dataset.findAndGetOFString(DCM_InstitutionName, value).good() && value == "Anonymous");
+	CHECK(!rules.FixTags(&dataset)); // no PatientBirthDate to delete, the rest has the values already
+
+	dataset.putAndInsertString(DCM_PatientBirthDate, "19700101");
+	CHECK(rules.FixTags(&dataset)); // deleted
+	CHECK(!dataset.tagExists(DCM_PatientBirthDate));
+	CHECK(!rules.FixTags(&dataset));
+
+	dataset.putAndInsertString(DCM_StudyDescription, "a-b");
+	CHECK(rules.FixTags(&dataset)); // becomes b-a
+	CHECK(rules.FixTags(&dataset)); // and back
+	dataset.putAndInsertString(DCM_StudyDescription, "a-a");
+	CHECK(!rules.FixTags(&dataset)); // swapping gives the same
+
+	DcmDataset empty;
+	CHECK(rules.FixTags(&empty)); // PatientSex and InstitutionName are added
+	CHECK(empty.tagExists(DCM_PatientSex));
+
+	// a rule reading a tag another rule changes gets the value from before (compile() warns about it)
+	const TagProcessorList chained(parse(R"json({
+		"PatientSex" : {"replace" : ["O"]},
+		"StudyDescription" : {"replace" : [["PatientSex", "(.*)", "sex $1"]]}
+	})json"));
+	DcmDataset patient;
+	patient.putAndInsertString(DCM_PatientSex, "F");
+	CHECK(chained.FixTags(&patient));
+	CHECK(patient.findAndGetOFString(DCM_StudyDescription, value).good() && value == "sex F");
+	CHECK(patient.findAndGetOFString(DCM_PatientSex, value).good() && value == "O");
+	return failures;
+}
@@ -0,0 +1,11 @@
+#include "check.hpp"
+#include <string>
+
+int failures = 0;
+
+// the shared code logs through the plugin wrapper, without Orthanc that goes to stderr
+namespace OrthancPlugins{
+void LogError(const std::string &message){std::cerr << "E: " << message << std::endl;}
+void LogWarning(const std::string &message){std::cerr << "W: " << message << std::endl;}
+void LogInfo(const std::string &){}
+}
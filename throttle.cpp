@@ -0,0 +1,20 @@
+#include "throttle.hpp"
+#include <thread>
+
+Throttle::Throttle(double rate):rate(rate), next(std::chrono::steady_clock::now()){}
+
+void Throttle::acquire(double amount)
+{
+	if(rate <= 0)
+		return;
+	std::chrono::steady_clock::time_point until;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto now = std::chrono::steady_clock::now();
+		if(next < now) // idle time doesn't accumulate into a burst
+			next = now;
+		until = next;
+		next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(amount / rate));
+	}
+	std::this_thread::sleep_until(until);
+}
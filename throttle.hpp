@@ -0,0 +1,21 @@
+#ifndef THROTTLE_HPP
+#define THROTTLE_HPP
+
+#include <chrono>
+#include <mutex>
+
+/**
+ * Paces work to a maximum rate (files, bytes, ... per second) across all threads using it.
+ * acquire() sleeps until the calling thread may go on. A rate of 0 means unlimited.
+ */
+class Throttle
+{
+	std::mutex mutex;
+	const double rate;
+	std::chrono::steady_clock::time_point next;
+public:
+	explicit Throttle(double rate);
+	void acquire(double amount = 1);
+};
+
+#endif //THROTTLE_HPP
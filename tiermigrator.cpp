@@ -0,0 +1,62 @@
+#include "tiermigrator.hpp"
+#include "shadowtree.hpp"
+#include "dedupstore.hpp"
+#include "filemove.hpp"
+#include <sys/stat.h>
+#include <ctime>
+
+namespace fs = boost::filesystem;
+
+TierMigrator::TierMigrator(TierStore &tiers, std::vector<std::chrono::seconds> ages, double bytes_per_second, std::chrono::seconds interval):
+	tiers(tiers), ages(std::move(ages)), throttle(bytes_per_second), interval(interval), thread(&TierMigrator::run, this){}
+
+TierMigrator::~TierMigrator()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void TierMigrator::pass()
+{
+	for(unsigned from = 0; from + 1 < tiers.roots().size(); from++){
+		const unsigned to = from + 1;
+		const time_t oldest = time(nullptr) - ages[to].count();
+		for(const fs::path &top:topDirectories({tiers.roots()[from]}))
+			for(const fs::path &leaf:leafDirectories(top)){
+				boost::system::error_code ec;
+				for(fs::directory_iterator file(leaf, ec), end; !ec && file != end && !stop; file.increment(ec)){
+					struct stat st;
+					if(!isAttachment(*file) || lstat(file->path().c_str(), &st))
+						continue;
+					if(std::max(st.st_atime, st.st_mtime) >= oldest)
+						continue;
+					if(!DedupStore::blobOf(file->path()).empty())
+						continue; // shared with other attachments, moving it would turn one file into many
+					const std::string uuid = file->path().filename().native();
+					const int64_t copied = moveOriginal(file->path(), GetOPath(uuid, tiers.roots()[to]), &throttle, &stop);
+					if(copied >= 0){
+						tiers.moved(uuid, to);
+						files++;
+						bytes += copied;
+					} else if(!stop)
+						errors++;
+				}
+				if(stop)
+					return;
+			}
+	}
+}
+
+void TierMigrator::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while(!wake.wait_for(lock, interval, [this]{return bool(stop);})){
+		lock.unlock();
+		pass();
+		lock.lock();
+	}
+}
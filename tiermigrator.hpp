@@ -0,0 +1,41 @@
+#ifndef TIERMIGRATOR_HPP
+#define TIERMIGRATOR_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "tierstore.hpp"
+#include "throttle.hpp"
+
+/**
+ * Background thread moving files that were not accessed for a while to the next (colder) storage tier.
+ * A file in tier i-1 goes to tier i once its last access (or modification) is longer ago than ages[i].
+ * Every interval all tiers but the last are walked. Copying is limited to bytes_per_second.
+ * The moves can be interrupted at any point (see moveOriginal), the next pass finishes them.
+ */
+class TierMigrator
+{
+	TierStore &tiers;
+	const std::vector<std::chrono::seconds> ages;
+	Throttle throttle;
+	const std::chrono::seconds interval;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<bool> stop{false};
+	std::thread thread;
+
+	void pass();
+	void run();
+public:
+	std::atomic<uint64_t> files{0}, bytes{0}, errors{0};
+
+	TierMigrator(TierStore &tiers, std::vector<std::chrono::seconds> ages, double bytes_per_second, std::chrono::seconds interval);
+	/// gives up the file being moved, the rest of the pass is left for the next run
+	~TierMigrator();
+};
+
+#endif //TIERMIGRATOR_HPP
@@ -0,0 +1,78 @@
+#include "tierstore.hpp"
+#include "shadowtree.hpp"
+#include <sys/stat.h>
+
+namespace fs = boost::filesystem;
+
+TierStore::TierStore(std::vector<fs::path> roots, size_t max_entries):roots_(std::move(roots)), max_entries(max_entries){}
+
+void TierStore::remember(const std::string &uuid, unsigned place)
+{
+	if(max_entries == 0)
+		return;
+	if(location.insert({uuid, place}).second)
+		order.push_back(uuid);
+	else
+		location[uuid] = place;
+	while(order.size() > max_entries){
+		location.erase(order.front()); // entries that were forgotten before are just skipped
+		order.pop_front();
+	}
+}
+
+unsigned TierStore::places()const
+{
+	return roots_.size() * (previous_layout ? 2 : 1);
+}
+
+fs::path TierStore::place(const std::string &uuid, unsigned place)const
+{
+	const fs::path &root = roots_[place % roots_.size()];
+	return place < roots_.size() ? layout.path(uuid, root) : previous_layout->path(uuid, root);
+}
+
+fs::path TierStore::locate(const std::string &uuid)
+{
+	unsigned found = 0;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const auto it = location.find(uuid);
+		if(it != location.end())
+			found = it->second;
+	}
+	lookups++;
+	return place(uuid, found);
+}
+
+fs::path TierStore::find(const std::string &uuid)
+{
+	struct stat st;
+	for(unsigned p = 0; p < places(); p++){
+		const fs::path path = place(uuid, p);
+		probes++;
+		if(stat(path.c_str(), &st) == 0){
+			std::lock_guard<std::mutex> lock(mutex);
+			if(p)
+				remember(uuid, p);
+			else
+				location.erase(uuid);
+			return path;
+		}
+	}
+	return place(uuid, 0);
+}
+
+void TierStore::moved(const std::string &uuid, unsigned tier)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if(tier)
+		remember(uuid, tier);
+	else
+		location.erase(uuid);
+}
+
+void TierStore::forget(const std::string &uuid)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	location.erase(uuid);
+}
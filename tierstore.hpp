@@ -0,0 +1,43 @@
+#ifndef TIERSTORE_HPP
+#define TIERSTORE_HPP
+
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Knows in which of several storage directories ("tiers"), and in which layout, the file of a uuid is.
+ * roots[0] is the hot tier, new files are always written there (in the current layout) and later moved down by the
+ * TierMigrator. Files found anywhere else (other tiers, or the previous layout) are remembered in a bounded map (oldest
+ * entries are forgotten first). So locate() never touches the disk, and only find() probes the places one after another.
+ */
+class TierStore
+{
+	const std::vector<boost::filesystem::path> roots_;
+	std::mutex mutex;
+	std::unordered_map<std::string, unsigned> location; // only files not in the hot tier in the current layout
+	std::deque<std::string> order;
+	const size_t max_entries;
+	void remember(const std::string &uuid, unsigned place);
+	/// places are all tiers in the current layout, followed by all tiers in the previous layout
+	boost::filesystem::path place(const std::string &uuid, unsigned place)const;
+	unsigned places()const;
+public:
+	std::atomic<uint64_t> lookups{0}, probes{0}; // calls to locate(), and stat calls done by find()
+
+	TierStore(std::vector<boost::filesystem::path> roots, size_t max_entries);
+	const std::vector<boost::filesystem::path> &roots()const{return roots_;}
+	/// where uuid is as far as we know, the hot tier if we don't (which may be wrong, then use find())
+	boost::filesystem::path locate(const std::string &uuid);
+	/// looks for uuid in all tiers (hot first) and remembers where it is, returns the hot tier if it is nowhere
+	boost::filesystem::path find(const std::string &uuid);
+	/// uuid was moved to tier (in the current layout)
+	void moved(const std::string &uuid, unsigned tier);
+	void forget(const std::string &uuid);
+};
+
+#endif //TIERSTORE_HPP
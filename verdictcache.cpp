@@ -0,0 +1,47 @@
+#include "verdictcache.hpp"
+
+VerdictCache::VerdictCache(size_t max_size):max_size(max_size){}
+
+void VerdictCache::renew(uint64_t current)
+{
+	if(current == generation)
+		return;
+	if(!verdicts.empty())
+		invalidations++;
+	verdicts.clear();
+	order.clear();
+	generation = current;
+}
+
+bool VerdictCache::find(const std::string &id, uint64_t current, bool &verdict)
+{
+	bool found=false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		renew(current);
+		auto it = verdicts.find(id);
+		if(it != verdicts.end()){
+			verdict = it->second;
+			found = true;
+		}
+	}
+	(found ? hits : misses)++;
+	return found;
+}
+
+void VerdictCache::insert(const std::string &id, uint64_t current, bool verdict)
+{
+	if(max_size == 0)
+		return;
+	std::lock_guard<std::mutex> lock(mutex);
+	if(current < generation) // checked against a mapping that is already gone
+		return;
+	renew(current);
+	if(!verdicts.emplace(id, verdict).second)
+		return;
+	order.push_back(id);
+	while(order.size() > max_size){
+		verdicts.erase(order.front());
+		order.pop_front();
+	}
+}
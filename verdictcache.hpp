@@ -0,0 +1,34 @@
+#ifndef VERDICTCACHE_HPP
+#define VERDICTCACHE_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Thread safe, bounded map of ids to the verdict of their last check.
+ * Lets the instance filter skip checking the same PatientID again for every instance of a series. Verdicts belong to a
+ * generation (of the patient mapping they depend on), all of them are dropped once a newer one is asked for. When full,
+ * the oldest entries are forgotten first.
+ */
+class VerdictCache
+{
+	std::mutex mutex;
+	std::unordered_map<std::string, bool> verdicts;
+	std::deque<std::string> order;
+	const size_t max_size;
+	uint64_t generation=0;
+
+	void renew(uint64_t current);
+public:
+	std::atomic<uint64_t> hits{0}, misses{0}, invalidations{0};
+
+	explicit VerdictCache(size_t max_size);
+	/// true if there is a verdict for id in generation current
+	bool find(const std::string &id, uint64_t current, bool &verdict);
+	void insert(const std::string &id, uint64_t current, bool verdict);
+};
+
+#endif //VERDICTCACHE_HPP
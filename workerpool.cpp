@@ -0,0 +1,63 @@
+#include "workerpool.hpp"
+
+WorkerPool::WorkerPool(unsigned threads, size_t max_queue):max_queue(max_queue ? max_queue : 1)
+{
+	for(unsigned i = 0; i < (threads ? threads : 1); i++)
+		this->threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	not_empty.notify_all();
+	not_full.notify_all();
+	for(auto &thread:threads)
+		thread.join();
+}
+
+bool WorkerPool::push(std::function<void()> &&job, bool wait)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if(wait)
+			not_full.wait(lock, [this]{return queue.size() < max_queue || stopping;});
+		if(stopping || queue.size() >= max_queue)
+			return false;
+		queue.push_back(std::move(job));
+	}
+	not_empty.notify_one();
+	return true;
+}
+
+void WorkerPool::run()
+{
+	for(;;){
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			not_empty.wait(lock, [this]{return !queue.empty() || stopping;});
+			if(queue.empty()) // stopping and nothing left to do
+				return;
+			job = std::move(queue.front());
+			queue.pop_front();
+		}
+		not_full.notify_one();
+		job();
+	}
+}
+
+void WorkerPool::forEach(size_t count, const std::function<void(size_t)> &fn, const std::atomic<bool> &cancelled)
+{
+	std::atomic<size_t> next{0};
+	std::vector<std::future<void>> done;
+	for(size_t t = 0; t < size(); t++)
+		done.push_back(submit([&]{
+			for(size_t i; !cancelled && (i = next++) < count;)
+				fn(i);
+		}));
+	for(auto &d:done)
+		d.get();
+}
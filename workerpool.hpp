@@ -0,0 +1,55 @@
+#ifndef WORKERPOOL_HPP
+#define WORKERPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed number of threads working off a bounded queue.
+ * submit() blocks while the queue is full, so a burst of work can't create more than threads+max_queue jobs in flight.
+ * The destructor finishes all queued jobs before joining the threads, jobs submitted after it started run in the caller.
+ */
+class WorkerPool
+{
+	std::mutex mutex;
+	std::condition_variable not_empty, not_full;
+	std::deque<std::function<void()>> queue;
+	std::vector<std::thread> threads;
+	const size_t max_queue;
+	bool stopping=false;
+
+	void run();
+	bool push(std::function<void()> &&job, bool wait);
+public:
+	WorkerPool(unsigned threads, size_t max_queue);
+	WorkerPool(const WorkerPool &) = delete;
+	WorkerPool &operator=(const WorkerPool &) = delete;
+	~WorkerPool();
+
+	template<typename F> std::future<typename std::result_of<F()>::type> submit(F job){
+		typedef typename std::result_of<F()>::type R;
+		auto task = std::make_shared<std::packaged_task<R()>>(std::move(job));
+		std::future<R> ret = task->get_future();
+		if(!push([task]{(*task)();}, true))
+			(*task)(); // the pool is shutting down, so the caller does the job and the future still gets its result
+		return ret;
+	}
+	/// queues job if there is room, drops it and returns false otherwise
+	bool trySubmit(std::function<void()> job){return push(std::move(job), false);}
+	/**
+	 * Calls fn(0) ... fn(count-1) spread over all threads and waits for them to finish.
+	 * Each thread takes the next index whenever it is done with one, until cancelled is set.
+	 * Must not be called from one of the pool's own threads.
+	 */
+	void forEach(size_t count, const std::function<void(size_t)> &fn, const std::atomic<bool> &cancelled);
+	size_t size()const{return threads.size();}
+};
+
+#endif //WORKERPOOL_HPP
@@ -0,0 +1,94 @@
+#include "xxhash.hpp"
+#include <cstring>
+
+namespace {
+const uint64_t P1 = 11400714785074694791ULL, P2 = 14029467366897019727ULL, P3 = 1609587929392839161ULL,
+	P4 = 9650029242287828579ULL, P5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r){return (x << r) | (x >> (64 - r));}
+// the input is read as little endian, memcpy keeps it free of alignment trouble
+inline uint64_t read64(const unsigned char *p){
+	uint64_t v;
+	memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+inline uint32_t read32(const unsigned char *p){
+	uint32_t v;
+	memcpy(&v, p, 4);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+inline uint64_t mixRound(uint64_t acc, uint64_t input){return rotl(acc + input * P2, 31) * P1;}
+inline uint64_t merge(uint64_t h, uint64_t acc){return (h ^ mixRound(0, acc)) * P1 + P4;}
+}
+
+XXH64::XXH64(uint64_t seed):acc{seed + P1 + P2, seed + P2, seed, seed - P1}, seed(seed){}
+
+void XXH64::update(const void *data, size_t size)
+{
+	const unsigned char *p = static_cast<const unsigned char *>(data), *const end = p + size;
+	total += size;
+	if(buffered + size < 32){
+		memcpy(buffer + buffered, p, size);
+		buffered += size;
+		return;
+	}
+	if(buffered){ // complete the stripe started by the last call
+		memcpy(buffer + buffered, p, 32 - buffered);
+		p += 32 - buffered;
+		for(int i = 0; i < 4; i++)
+			acc[i] = mixRound(acc[i], read64(buffer + 8 * i));
+		buffered = 0;
+	}
+	uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+	for(; p + 32 <= end; p += 32){
+		a0 = mixRound(a0, read64(p));
+		a1 = mixRound(a1, read64(p + 8));
+		a2 = mixRound(a2, read64(p + 16));
+		a3 = mixRound(a3, read64(p + 24));
+	}
+	acc[0] = a0; acc[1] = a1; acc[2] = a2; acc[3] = a3;
+	buffered = end - p;
+	memcpy(buffer, p, buffered);
+}
+
+uint64_t XXH64::digest()const
+{
+	uint64_t h;
+	if(total >= 32){
+		h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+		for(int i = 0; i < 4; i++)
+			h = merge(h, acc[i]);
+	} else
+		h = seed + P5;
+	h += total;
+
+	const unsigned char *p = buffer, *const end = buffer + buffered;
+	for(; p + 8 <= end; p += 8)
+		h = rotl(h ^ mixRound(0, read64(p)), 27) * P1 + P4;
+	if(p + 4 <= end){
+		h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+		p += 4;
+	}
+	for(; p < end; p++)
+		h = rotl(h ^ (*p * P5), 11) * P1;
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t XXH64::hash(const void *data, size_t size, uint64_t seed)
+{
+	XXH64 state(seed);
+	state.update(data, size);
+	return state.digest();
+}
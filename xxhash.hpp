@@ -0,0 +1,25 @@
+#ifndef XXHASH_HPP
+#define XXHASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * XXH64 (https://github.com/Cyan4973/xxHash), a fast non-cryptographic 64bit hash.
+ * Data can be fed in pieces of any size, the result is the same as hashing it in one go.
+ */
+class XXH64
+{
+	uint64_t acc[4];
+	unsigned char buffer[32]; // input that doesn't fill a whole stripe yet
+	size_t buffered=0;
+	uint64_t total=0;
+	const uint64_t seed;
+public:
+	explicit XXH64(uint64_t seed = 0);
+	void update(const void *data, size_t size);
+	uint64_t digest()const;
+	static uint64_t hash(const void *data, size_t size, uint64_t seed = 0);
+};
+
+#endif //XXHASH_HPP